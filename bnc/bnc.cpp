@@ -0,0 +1,138 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include "Emit.h"
+#include "Logger.h"
+#include "Lua.h"
+
+using namespace std;
+
+namespace
+{
+
+	/** Run a benchmark and print the average time per iteration.
+	 * @param name_i Name of the benchmark.
+	 * @param iter_i Number of iterations.
+	 * @param fnc_i Function running a single iteration. */
+	void bench(const string & name_i, const size_t iter_i, const function<void()> & fnc_i)
+	{
+		auto start = chrono::steady_clock::now();
+		for (size_t i = 0; i < iter_i; i++) fnc_i();
+		chrono::duration<double, nano> dur = chrono::steady_clock::now() - start;
+		cout << left << setw(32) << name_i << right << setw(12) << fixed << setprecision(1);
+		cout << dur.count() / iter_i << " ns/op" << endl;
+	}
+
+	/** Benchmark calling a precompiled Lua chunk.
+	 * @param lua_i Lua state to use.
+	 * @param name_i Name of the benchmark.
+	 * @param code_i Lua code of the chunk.
+	 * @param iter_i Number of iterations. */
+	void chunk(Clte::Lua & lua_i, const string & name_i, const string & code_i, const size_t iter_i)
+	{
+		int ref = lua_i.compile(code_i, name_i);
+		if (ref == LUA_NOREF) return;
+
+		bench(name_i, iter_i, [&]() {
+			lua_i.call(ref, 1, name_i);
+			lua_pop(lua_i.state(), 1);
+		});
+		lua_i.release(ref);
+	}
+
+	/// Stream buffer discarding everything written to it
+	class NullBuf : public streambuf
+	{
+		protected:
+		int_type overflow(int_type ch_i) override { return traits_type::not_eof(ch_i); }
+		streamsize xsputn(const char * str_i, streamsize cnt_i) override { UNUSED(str_i); return cnt_i; }
+	};
+
+	/** Benchmark emitting literal runs of a single size class, against
+	 * writing them to the output stream directly.
+	 * @param len_i Length of the runs.
+	 * @param iter_i Number of iterations. */
+	template <Clte::Emit::class_t C>
+	void emit(const size_t len_i, const size_t iter_i)
+	{
+		static const string src(16384, 'x');
+		string_view run(src.data(), len_i);
+		NullBuf nbf;
+		ostream os(&nbf);
+		Clte::Emitter emt(os);
+
+		bench("emit " + to_string(len_i) + " bytes", iter_i, [&]() { emt.emit<C>(run); });
+		bench("ostream::write " + to_string(len_i) + " bytes", iter_i, [&]() { os.write(run.data(), run.size()); });
+	}
+
+} // Anonymous namespace
+
+/** Runs the benchmarks. Build with different LUA_BACKEND settings and
+ * compare the output to compare Lua implementations.
+ * @returns 0 on success. */
+int main(int argc, char *argv[])
+{
+	UNUSED(argc);
+	UNUSED(argv);
+	Fs2a::Logger::instance()->stderror(strlen(STR(REPOROOT)) + 1);
+	Clte::Lua lua;
+	string res;
+
+	cout << "Lua backend: " << Clte::Lua::backend() << endl;
+
+	lua.run("names = {} for i = 1, 100 do names[i] = 'column_' .. i end", "setup");
+
+	bench("eval simple expression", 100000, [&]() {
+		lua.eval("1 + 2 * 3", "eval", res);
+	});
+	chunk(lua, "string upper/rep", "return ('abc'):rep(20):upper()", 200000);
+	chunk(lua, "string.format", "return string.format('%s_%08d', 'id', 42)", 200000);
+	chunk(lua, "gsub camel to snake",
+		"return (('SomeLongTableName'):gsub('(%l)(%u)', '%1_%2'):lower())", 100000);
+	chunk(lua, "concat loop of 100",
+		"local t = {} for i, n in ipairs(names) do t[i] = n:upper() end return table.concat(t, ', ')", 10000);
+
+	emit<Clte::Emit::inline16>(11, 10000000);
+	emit<Clte::Emit::inline32>(27, 10000000);
+	emit<Clte::Emit::inline64>(50, 10000000);
+	emit<Clte::Emit::copy>(1000, 1000000);
+	emit<Clte::Emit::reference>(16384, 100000);
+
+	return 0;
+}
@@ -0,0 +1,200 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <sstream>
+#include <string>
+#include <cppunit/extensions/HelperMacros.h>
+#include "Binding.h"
+#include "Data.h"
+#include "Lua.h"
+
+using namespace std;
+using Clte::Binding;
+using Clte::Data;
+using Clte::Lua;
+
+/// Checks of binding data documents into Lua through proxies
+class BindingCheck : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(BindingCheck);
+	CPPUNIT_TEST(access);
+	CPPUNIT_TEST(iteration);
+	CPPUNIT_TEST(identity);
+	CPPUNIT_TEST(largeMap);
+	CPPUNIT_TEST(readOnly);
+	CPPUNIT_TEST(interned);
+	CPPUNIT_TEST(unbound);
+	CPPUNIT_TEST_SUITE_END();
+
+	protected:
+	/// Lua state to bind into
+	Lua lua_a;
+
+	/// Binding under test
+	Binding binding_a;
+
+	/// Bound document
+	Data data_a;
+
+	/** Evaluate an expression.
+	 * @param expr_i Lua expression.
+	 * @returns Result converted to a string. */
+	string eval(const string & expr_i)
+	{
+		string res;
+		CPPUNIT_ASSERT_MESSAGE(expr_i, lua_a.eval(expr_i, "check", res));
+		return res;
+	}
+
+	/** Load a document, bind it and make it available as global data.
+	 * @param yaml_i YAML document. */
+	void bind(const string & yaml_i)
+	{
+		istringstream iss(yaml_i);
+		lua_State * L = lua_a.state();
+
+		CPPUNIT_ASSERT(data_a.yaml(iss, "document"));
+		binding_a.bind(data_a);
+		CPPUNIT_ASSERT(binding_a.protectedPush(data_a.root(), "data"));
+		lua_setglobal(L, "data");
+	}
+
+	public:
+	/// Constructor
+	BindingCheck()
+	: binding_a(lua_a)
+	{ }
+
+	/// Bind the same document for every check
+	void setUp() override
+	{
+		bind(
+			"name: check\n"
+			"items: [ a, b, c ]\n"
+			"empty: ~\n"
+			"anchor: &anc { key: value }\n"
+			"alias: *anc\n"
+			"twice: { key: first, key: later }\n");
+	}
+
+	/// Release the document before it is destroyed
+	void tearDown() override
+	{
+		binding_a.unbind();
+	}
+
+	/// Scalars are strings, collections are indexed like tables
+	void access()
+	{
+		CPPUNIT_ASSERT_EQUAL(string("check"), eval("data.name"));
+		CPPUNIT_ASSERT_EQUAL(string("later"), eval("data.twice.key"));
+		CPPUNIT_ASSERT_EQUAL(string("3"), eval("#data.items"));
+		CPPUNIT_ASSERT_EQUAL(string("b"), eval("data.items[2]"));
+		CPPUNIT_ASSERT_EQUAL(string("userdata"), eval("type(data.items)"));
+		CPPUNIT_ASSERT_EQUAL(string("value"), eval("data.alias.key"));
+		CPPUNIT_ASSERT_EQUAL(string("true"), eval("data.empty == nil and data.missing == nil"));
+		CPPUNIT_ASSERT_EQUAL(string("true"), eval("data.items[0] == nil and data.items[4] == nil and data.items[1.5] == nil"));
+		CPPUNIT_ASSERT_EQUAL(string("true"), eval("data[1] == nil and data.items.x == nil"));
+	}
+
+	/** pairs() and ipairs() walk proxies in document order, skipping
+	 * null values like a table would */
+	void iteration()
+	{
+		CPPUNIT_ASSERT_EQUAL(string("1a2b3c"), eval("(function() local s = '' for i, v in ipairs(data.items) do s = s .. i .. v end return s end)()"));
+		CPPUNIT_ASSERT_EQUAL(string("name,items,anchor,alias,twice,"), eval("(function() local s = '' for k in pairs(data) do s = s .. k .. ',' end return s end)()"));
+
+		// Plain tables still iterate as before
+		CPPUNIT_ASSERT_EQUAL(string("xy"), eval("(function() local s = '' for _, v in ipairs({ 'x', 'y' }) do s = s .. v end return s end)()"));
+	}
+
+	/// The same node is always the same proxy, also through aliases
+	void identity()
+	{
+		lua_State * L = lua_a.state();
+		Data::Node nd;
+
+		CPPUNIT_ASSERT_EQUAL(string("true"), eval("rawequal(data.items, data.items) and rawequal(data.anchor, data.alias)"));
+
+		lua_getglobal(L, "data");
+		lua_getfield(L, -1, "items");
+		CPPUNIT_ASSERT(binding_a.node(-1, nd));
+		CPPUNIT_ASSERT_EQUAL(data_a.root().find("items").index(), nd.index());
+		lua_pushliteral(L, "text");
+		CPPUNIT_ASSERT(!binding_a.node(-1, nd));
+		lua_pop(L, 3);
+	}
+
+	/// Maps too large for a linear search find their keys as well
+	void largeMap()
+	{
+		string yaml("big:\n");
+		for (int i = 0; i < 100; i++) yaml += "  k" + to_string(i) + ": v" + to_string(i) + "\n";
+		yaml += "  k5: last\n";
+
+		binding_a.unbind();
+		bind(yaml);
+		CPPUNIT_ASSERT_EQUAL(string("v0 v99 last"), eval("data.big.k0 .. ' ' .. data.big.k99 .. ' ' .. data.big.k5"));
+		CPPUNIT_ASSERT_EQUAL(string("true"), eval("data.big.k100 == nil"));
+	}
+
+	/// Templates can't modify the document or get at the metatable
+	void readOnly()
+	{
+		CPPUNIT_ASSERT(!lua_a.run("data.name = 'x'", "check"));
+		CPPUNIT_ASSERT(!lua_a.run("data.items[1] = 'x'", "check"));
+		CPPUNIT_ASSERT_EQUAL(string("false"), eval("getmetatable(data)"));
+		CPPUNIT_ASSERT_EQUAL(string("check"), eval("data.name"));
+	}
+
+	/// Strings pushed again come from the interned table
+	void interned()
+	{
+		uint64_t before = binding_a.avoided();
+		eval("data.items[1] .. data.items[1] .. data.items[1]");
+		CPPUNIT_ASSERT(binding_a.avoided() >= before + 2);
+	}
+
+	/// Proxies kept beyond unbind() raise an error instead of reading freed
+	/// memory
+	void unbound()
+	{
+		CPPUNIT_ASSERT(lua_a.run("kept = data.items", "check"));
+		binding_a.unbind();
+		string res;
+		CPPUNIT_ASSERT(!lua_a.eval("kept[1]", "check", res));
+		CPPUNIT_ASSERT(!lua_a.eval("#kept", "check", res));
+		CPPUNIT_ASSERT(!lua_a.run("for k in pairs(kept) do end", "check"));
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(BindingCheck);
@@ -0,0 +1,161 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cppunit/extensions/HelperMacros.h>
+#include "Chunks.h"
+#include "Renderer.h"
+#include "Scratch.h"
+
+using namespace std;
+using Clte::Chunks;
+using Clte::Renderer;
+
+/// Checks of pulling rendered output in chunks
+class ChunksCheck : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(ChunksCheck);
+	CPPUNIT_TEST(pulled);
+	CPPUNIT_TEST(failed);
+	CPPUNIT_TEST(cancelled);
+	CPPUNIT_TEST(rejected);
+	CPPUNIT_TEST_SUITE_END();
+
+	protected:
+	/// Template writing a few hundred lines
+	static const char * const lines;
+
+	/// Directory for the data files
+	Scratch dir_a;
+
+	/** Set up a renderer for a template, on a data file with a sequence
+	 * of 300 numbers.
+	 * @param rnd_o Renderer to set up.
+	 * @param tpl_i Template, must outlive the renderer. */
+	void prepare(Renderer & rnd_o, istringstream & tpl_i)
+	{
+		ostringstream oss;
+
+		for (size_t i = 1; i <= 300; i++) oss << "- " << i << "\n";
+		dir_a.write("data.yaml", oss.str());
+		rnd_o.in(&tpl_i);
+		CPPUNIT_ASSERT(rnd_o.data(dir_a.path("data.yaml")));
+	}
+
+	/** Render a template into a string.
+	 * @param tpl_i Template.
+	 * @returns Rendered output. */
+	string render(const string & tpl_i)
+	{
+		Renderer rnd;
+		istringstream in(tpl_i);
+		ostringstream out;
+
+		prepare(rnd, in);
+		rnd.out(&out);
+		rnd.render();
+		return out.str();
+	}
+
+	public:
+	/** All output arrives in order, in chunks of at most the buffer size,
+	 * and the end stays the end */
+	void pulled()
+	{
+		Renderer rnd;
+		istringstream in(lines);
+		vector<char> chunk;
+		string all;
+		size_t count = 0;
+
+		prepare(rnd, in);
+		Chunks chk(rnd, 100, 2);
+		while (chk.next(chunk)) {
+			CPPUNIT_ASSERT(!chunk.empty());
+			CPPUNIT_ASSERT(chunk.size() <= 100);
+			all.append(chunk.data(), chunk.size());
+			count++;
+		}
+
+		CPPUNIT_ASSERT_EQUAL(render(lines), all);
+		CPPUNIT_ASSERT(count >= all.size() / 100);
+		CPPUNIT_ASSERT(!chk.next(chunk));
+	}
+
+	/// An error of the renderer comes after the output before it
+	void failed()
+	{
+		Renderer rnd;
+		istringstream in("before @! error('broken') @;after");
+		vector<char> chunk;
+
+		prepare(rnd, in);
+		Chunks chk(rnd, 4, 1);
+		string all;
+		CPPUNIT_ASSERT_THROW(while (chk.next(chunk)) all.append(chunk.data(), chunk.size()), std::runtime_error);
+		CPPUNIT_ASSERT_EQUAL(string("before "), all);
+		CPPUNIT_ASSERT(!chk.next(chunk));
+	}
+
+	/// Output that isn't pulled anymore doesn't keep the renderer waiting
+	void cancelled()
+	{
+		Renderer rnd;
+		istringstream in(lines);
+		vector<char> chunk;
+
+		prepare(rnd, in);
+		unique_ptr<Chunks> chk(new Chunks(rnd, 16, 1));
+		CPPUNIT_ASSERT(chk->next(chunk));
+		chk.reset();
+	}
+
+	/// Invalid sizes and a renderer with an output are rejected
+	void rejected()
+	{
+		Renderer rnd;
+		ostringstream out;
+
+		CPPUNIT_ASSERT_THROW(Chunks(rnd, 0, 1), std::invalid_argument);
+		CPPUNIT_ASSERT_THROW(Chunks(rnd, 16, 0), std::invalid_argument);
+		rnd.out(&out);
+		CPPUNIT_ASSERT_THROW(Chunks(rnd, 16, 1), std::logic_error);
+	}
+};
+
+const char * const ChunksCheck::lines = "@$ data @.line @= @+ @.\n@;";
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ChunksCheck);
@@ -0,0 +1,263 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <cppunit/extensions/HelperMacros.h>
+#include "Data.h"
+#include "Scratch.h"
+
+using namespace std;
+using Clte::Data;
+
+/// Checks of the precompiled data format
+class DataCheck : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(DataCheck);
+	CPPUNIT_TEST(roundTrip);
+	CPPUNIT_TEST(aliases);
+	CPPUNIT_TEST(rejectHeader);
+	CPPUNIT_TEST(rejectChecksum);
+	CPPUNIT_TEST(rejectChild);
+	CPPUNIT_TEST(rejectString);
+	CPPUNIT_TEST(rejectType);
+	CPPUNIT_TEST_SUITE_END();
+
+	protected:
+	/// Document used by all checks
+	static const char * const document;
+
+	/// Directory for the image files
+	Scratch dir_a;
+
+	/** Build the document and save it as an image.
+	 * @returns Image words, so the image is 8-byte aligned. */
+	vector<uint64_t> image()
+	{
+		Data dt;
+		istringstream iss(document);
+
+		CPPUNIT_ASSERT(dt.yaml(iss, "document"));
+		CPPUNIT_ASSERT(dt.save(dir_a.path("good.clted")));
+
+		string raw = dir_a.read("good.clted");
+		vector<uint64_t> img(raw.size() / sizeof(uint64_t));
+		CPPUNIT_ASSERT_EQUAL(raw.size(), img.size() * sizeof(uint64_t));
+		memcpy(img.data(), raw.data(), raw.size());
+		return img;
+	}
+
+	/** Get the header of an image.
+	 * @param img_io Image words.
+	 * @returns Reference to the header. */
+	Data::Header & header(vector<uint64_t> & img_io)
+	{
+		return *reinterpret_cast<Data::Header *>(img_io.data());
+	}
+
+	/** Save a modified image and check that mapping it fails without
+	 * leaving a document behind.
+	 * @param img_io Image words.
+	 * @param checksum_i True to recalculate the checksum, default true. */
+	void reject(vector<uint64_t> & img_io, const bool checksum_i = true)
+	{
+		const char * start = reinterpret_cast<const char *>(img_io.data());
+		size_t size = img_io.size() * sizeof(uint64_t);
+		Data dt;
+
+		if (checksum_i) header(img_io).checksum = Data::checksum(start + sizeof(Data::Header), size - sizeof(Data::Header));
+		dir_a.write("bad.clted", string(start, size));
+		CPPUNIT_ASSERT(!dt.map(dir_a.path("bad.clted")));
+		CPPUNIT_ASSERT(dt.empty());
+	}
+
+	public:
+	/// Build, save and map a document and compare both
+	void roundTrip()
+	{
+		Data dt, ld;
+		istringstream iss(document);
+
+		CPPUNIT_ASSERT(dt.yaml(iss, "document"));
+		CPPUNIT_ASSERT(dt.save(dir_a.path("data.clted")));
+		CPPUNIT_ASSERT(ld.load(dir_a.path("data.clted")));
+		CPPUNIT_ASSERT_EQUAL(dt.header().size, ld.header().size);
+		CPPUNIT_ASSERT_EQUAL(dt.root().hash(), ld.root().hash());
+
+		Data::Node root = ld.root();
+		CPPUNIT_ASSERT(root.type() == Data::map_node);
+		CPPUNIT_ASSERT(root.find("name").scalar() == "check");
+		CPPUNIT_ASSERT(!root.find("missing"));
+
+		Data::Node items = root.find("items");
+		CPPUNIT_ASSERT(items.type() == Data::sequence_node);
+		CPPUNIT_ASSERT_EQUAL(size_t(3), items.size());
+		CPPUNIT_ASSERT(items[1].scalar() == "b");
+		CPPUNIT_ASSERT_THROW(items[3], std::out_of_range);
+
+		// Equal strings are stored once
+		CPPUNIT_ASSERT_EQUAL(items[0].string(), items[2].string());
+
+		// A null value is present as a key, but has no content
+		CPPUNIT_ASSERT_EQUAL(size_t(5), root.size());
+		CPPUNIT_ASSERT(root.key(2).scalar() == "empty");
+		CPPUNIT_ASSERT(root.value(2).type() == Data::null_node);
+	}
+
+	/// Nodes shared through aliases are stored once and encode equally
+	void aliases()
+	{
+		Data dt;
+		istringstream iss(document);
+		CPPUNIT_ASSERT(dt.yaml(iss, "document"));
+
+		Data::Node anchor = dt.root().find("anchor"), alias = dt.root().find("alias");
+		CPPUNIT_ASSERT_EQUAL(anchor.index(), alias.index());
+		CPPUNIT_ASSERT(alias.find("key").scalar() == "value");
+
+		// A changed scalar changes the encoding and hash of the document
+		Data other;
+		istringstream changed(string(document) + "extra: 1\n");
+		CPPUNIT_ASSERT(other.yaml(changed, "changed"));
+		CPPUNIT_ASSERT(dt.root().hash() != other.root().hash());
+
+		string enc, otherenc;
+		unordered_map<uint32_t, uint32_t> seen, otherseen;
+		dt.root().encode(enc, seen);
+		other.root().encode(otherenc, otherseen);
+		CPPUNIT_ASSERT(enc != otherenc);
+	}
+
+	/// Images with a wrong header or size are rejected
+	void rejectHeader()
+	{
+		vector<uint64_t> img = image();
+		header(img).version++;
+		reject(img);
+
+		img = image();
+		header(img).order = 0x04030201;
+		reject(img);
+
+		img = image();
+		header(img).nodecount = 0xffffffff;
+		reject(img);
+
+		img = image();
+		header(img).bytes = header(img).size + 8;
+		reject(img);
+
+		img = image();
+		img.pop_back();
+		reject(img);
+	}
+
+	/// Images with changed content but the old checksum are rejected
+	void rejectChecksum()
+	{
+		vector<uint64_t> img = image();
+		img.back() ^= 1;
+		reject(img, false);
+	}
+
+	/** Images with a child index out of range are rejected, even with a
+	 * valid checksum */
+	void rejectChild()
+	{
+		vector<uint64_t> img = image();
+		Data::Header & hdr = header(img);
+		uint32_t * kids = reinterpret_cast<uint32_t *>(reinterpret_cast<char *>(img.data()) + hdr.children);
+
+		CPPUNIT_ASSERT(hdr.childcount > 0);
+		kids[0] = hdr.nodecount + 5;
+		reject(img);
+
+		// A child referring to its own parent would be a cycle
+		img = image();
+		kids = reinterpret_cast<uint32_t *>(reinterpret_cast<char *>(img.data()) + header(img).children);
+		kids[header(img).childcount - 1] = header(img).root;
+		reject(img);
+	}
+
+	/** Images with a string index, offset or length out of range are
+	 * rejected */
+	void rejectString()
+	{
+		vector<uint64_t> img = image();
+		Data::Header * hdr = &header(img);
+		Data::String * strs = reinterpret_cast<Data::String *>(reinterpret_cast<char *>(img.data()) + hdr->strings);
+		strs[0].offset = hdr->size;
+		reject(img);
+
+		img = image();
+		hdr = &header(img);
+		strs = reinterpret_cast<Data::String *>(reinterpret_cast<char *>(img.data()) + hdr->strings);
+		strs[0].length = ~static_cast<uint64_t>(0);
+		reject(img);
+
+		img = image();
+		hdr = &header(img);
+		Data::Entry * ents = reinterpret_cast<Data::Entry *>(reinterpret_cast<char *>(img.data()) + hdr->nodes);
+		CPPUNIT_ASSERT(ents[0].type == Data::scalar_node);
+		ents[0].value = hdr->stringcount;
+		reject(img);
+	}
+
+	/** Images with a node of unknown type or with too many children are
+	 * rejected */
+	void rejectType()
+	{
+		vector<uint64_t> img = image();
+		Data::Header * hdr = &header(img);
+		Data::Entry * ents = reinterpret_cast<Data::Entry *>(reinterpret_cast<char *>(img.data()) + hdr->nodes);
+		ents[0].type = 7;
+		reject(img);
+
+		img = image();
+		hdr = &header(img);
+		ents = reinterpret_cast<Data::Entry *>(reinterpret_cast<char *>(img.data()) + hdr->nodes);
+		ents[hdr->root].size = 0x80000000;
+		reject(img);
+	}
+};
+
+const char * const DataCheck::document =
+	"name: check\n"
+	"items: [ a, b, a ]\n"
+	"empty: ~\n"
+	"anchor: &anc { key: value }\n"
+	"alias: *anc\n";
+
+CPPUNIT_TEST_SUITE_REGISTRATION(DataCheck);
@@ -0,0 +1,144 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <cppunit/extensions/HelperMacros.h>
+#include "Emit.h"
+
+using namespace std;
+using Clte::Emitter;
+namespace Emit = Clte::Emit;
+
+/// Checks of the size class specialised emit routines
+class EmitCheck : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(EmitCheck);
+	CPPUNIT_TEST(classify);
+	CPPUNIT_TEST(small);
+	CPPUNIT_TEST(ordered);
+	CPPUNIT_TEST(target);
+	CPPUNIT_TEST_SUITE_END();
+
+	protected:
+	/** Copy every length up to N with Emit::small() and check that exactly
+	 * those bytes are written.
+	 * @tparam N Size of the routine. */
+	template <size_t N>
+	void copies()
+	{
+		char src[N], dst[N + 2];
+		for (size_t i = 0; i < N; i++) src[i] = 'a' + i % 26;
+
+		for (size_t len = 0; len <= N; len++) {
+			memset(dst, '#', sizeof(dst));
+			Emit::small<N>(dst + 1, src, len);
+			CPPUNIT_ASSERT_EQUAL('#', dst[0]);
+			CPPUNIT_ASSERT(memcmp(dst + 1, src, len) == 0);
+			for (size_t i = len + 1; i < sizeof(dst); i++) CPPUNIT_ASSERT_EQUAL('#', dst[i]);
+		}
+	}
+
+	public:
+	/// Runs are classified by their length, inclusive upper bounds
+	void classify()
+	{
+		CPPUNIT_ASSERT(Emit::classify(0) == Emit::inline16);
+		CPPUNIT_ASSERT(Emit::classify(16) == Emit::inline16);
+		CPPUNIT_ASSERT(Emit::classify(17) == Emit::inline32);
+		CPPUNIT_ASSERT(Emit::classify(32) == Emit::inline32);
+		CPPUNIT_ASSERT(Emit::classify(33) == Emit::inline64);
+		CPPUNIT_ASSERT(Emit::classify(64) == Emit::inline64);
+		CPPUNIT_ASSERT(Emit::classify(65) == Emit::copy);
+		CPPUNIT_ASSERT(Emit::classify(Emit::large) == Emit::copy);
+		CPPUNIT_ASSERT(Emit::classify(Emit::large + 1) == Emit::reference);
+	}
+
+	/// Inline copies write exactly the requested bytes for every length
+	void small()
+	{
+		copies<4>();
+		copies<16>();
+		copies<32>();
+		copies<64>();
+	}
+
+	/** Runs of all size classes end up in order, also across a full
+	 * buffer */
+	void ordered()
+	{
+		ostringstream out, expect;
+
+		{
+			Emitter emt(out);
+			for (size_t i = 0; i < 200; i++) {
+				size_t len = (i * 37) % 300 + (i % 50 == 0 ? Emit::large : 0);
+				string run(len, 'a' + i % 26);
+				emt.write(run);
+				expect << run;
+			}
+			CPPUNIT_ASSERT(emt.flush());
+			CPPUNIT_ASSERT_EQUAL(expect.str(), out.str());
+
+			// A large run goes after the output buffered before it
+			emt.emit<Emit::inline16>("head");
+			emt.emit<Emit::reference>(string(Emit::large + 1, 'r'));
+			emt.emit<Emit::copy>(string(100, 't'));
+			expect << "head" << string(Emit::large + 1, 'r') << string(100, 't');
+		}
+
+		// The destructor flushes the rest
+		CPPUNIT_ASSERT_EQUAL(expect.str(), out.str());
+	}
+
+	/// Switching the target writes buffered output to the previous one
+	void target()
+	{
+		ostringstream first, second;
+
+		{
+			Emitter emt(first);
+			emt.write("one");
+			emt.target(second);
+			CPPUNIT_ASSERT(&emt.stream() == &second);
+			emt.write("two");
+			emt.target(first);
+			emt.write("three");
+		}
+
+		CPPUNIT_ASSERT_EQUAL(string("onethree"), first.str());
+		CPPUNIT_ASSERT_EQUAL(string("two"), second.str());
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(EmitCheck);
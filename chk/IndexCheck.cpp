@@ -0,0 +1,215 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cppunit/extensions/HelperMacros.h>
+#include "Data.h"
+#include "Index.h"
+#include "Renderer.h"
+#include "Scratch.h"
+
+using namespace std;
+using Clte::Data;
+using Clte::Index;
+using Clte::Renderer;
+
+/// Checks of the secondary data indexes
+class IndexCheck : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(IndexCheck);
+	CPPUNIT_TEST(declared);
+	CPPUNIT_TEST(found);
+	CPPUNIT_TEST(sequences);
+	CPPUNIT_TEST(maps);
+	CPPUNIT_TEST(lookup);
+	CPPUNIT_TEST(popular);
+	CPPUNIT_TEST_SUITE_END();
+
+	protected:
+	/// Document used by the checks of the index itself
+	static const char * const document;
+
+	/// Directory for the data files
+	Scratch dir_a;
+
+	/** Get the names of the elements having a value in an index.
+	 * @param dt_i Indexed document.
+	 * @param idx_i Index.
+	 * @param spec_i Declaration of the index.
+	 * @param key_i Value to look up.
+	 * @returns Names separated by spaces. */
+	static string names(const Data & dt_i, const Index & idx_i, const string & spec_i, const string & key_i)
+	{
+		const vector<uint32_t> * nodes = nullptr;
+		string res;
+
+		CPPUNIT_ASSERT(idx_i.find(spec_i, key_i, nodes));
+		if (nodes == nullptr) return res;
+		for (uint32_t node : *nodes) {
+			if (!res.empty()) res += ' ';
+			res += dt_i.node(node).find("name").scalar();
+		}
+		return res;
+	}
+
+	/** Render a template once with a fresh renderer.
+	 * @param tpl_i Template.
+	 * @param spec_i Index to declare, none if empty.
+	 * @returns Rendered output. */
+	string render(const string & tpl_i, const string & spec_i = "")
+	{
+		Renderer rnd;
+		istringstream in(tpl_i);
+		ostringstream out;
+
+		rnd.in(&in);
+		rnd.out(&out);
+		if (!spec_i.empty()) CPPUNIT_ASSERT(rnd.index(spec_i));
+		CPPUNIT_ASSERT(rnd.data(dir_a.path("data.yaml")));
+		rnd.render();
+		return out.str();
+	}
+
+	public:
+	/// Malformed declarations are rejected, declarations in the data used
+	void declared()
+	{
+		Data dt;
+		Index idx;
+		istringstream iss(document);
+		const vector<uint32_t> * nodes = nullptr;
+
+		CPPUNIT_ASSERT(!idx.declare("schema.tables"));
+		CPPUNIT_ASSERT(!idx.declare("schema.tables:"));
+		CPPUNIT_ASSERT(idx.declare("schema.tables:name"));
+		CPPUNIT_ASSERT(dt.yaml(iss, "document"));
+		idx.build(dt);
+
+		CPPUNIT_ASSERT_EQUAL(size_t(2), idx.size());
+		CPPUNIT_ASSERT(idx.find("schema.columns:refs", "users", nodes));
+		CPPUNIT_ASSERT(!idx.find("schema.columns:name", "id", nodes));
+		CPPUNIT_ASSERT(nodes == nullptr);
+
+		// Rebuilding keeps the declarations
+		idx.clear();
+		CPPUNIT_ASSERT_EQUAL(size_t(0), idx.size());
+		idx.build(dt);
+		CPPUNIT_ASSERT_EQUAL(size_t(2), idx.size());
+	}
+
+	/// Scalar fields find all elements having them, in document order
+	void found()
+	{
+		Data dt;
+		Index idx;
+		istringstream iss(document);
+
+		CPPUNIT_ASSERT(dt.yaml(iss, "document"));
+		CPPUNIT_ASSERT(idx.declare("schema.tables:owner"));
+		CPPUNIT_ASSERT_EQUAL(size_t(9), idx.build(dt));
+
+		CPPUNIT_ASSERT_EQUAL(string("users orders"), names(dt, idx, "schema.tables:owner", "shop"));
+		CPPUNIT_ASSERT_EQUAL(string("log"), names(dt, idx, "schema.tables:owner", "ops"));
+		CPPUNIT_ASSERT_EQUAL(string(), names(dt, idx, "schema.tables:owner", "nobody"));
+		CPPUNIT_ASSERT_EQUAL(string("orders"), names(dt, idx, "schema.tables:name", "orders"));
+	}
+
+	/// Every scalar of a sequence field is indexed, duplicates once
+	void sequences()
+	{
+		Data dt;
+		Index idx;
+		istringstream iss(document);
+
+		CPPUNIT_ASSERT(dt.yaml(iss, "document"));
+		idx.build(dt);
+
+		CPPUNIT_ASSERT_EQUAL(string("user order_user"), names(dt, idx, "schema.columns:refs", "users"));
+		CPPUNIT_ASSERT_EQUAL(string("order_user"), names(dt, idx, "schema.columns:refs", "orders"));
+		CPPUNIT_ASSERT_EQUAL(string(), names(dt, idx, "schema.columns:refs", "log"));
+	}
+
+	/// The values of a map are indexed like the elements of a sequence
+	void maps()
+	{
+		Data dt;
+		Index idx;
+		istringstream iss("hosts:\n  a: { name: alpha, role: web }\n  b: { name: beta, role: db }\n  c: { name: gamma, role: web }\n");
+
+		CPPUNIT_ASSERT(dt.yaml(iss, "hosts"));
+		CPPUNIT_ASSERT(idx.declare("hosts:role"));
+		idx.build(dt);
+
+		CPPUNIT_ASSERT_EQUAL(string("alpha gamma"), names(dt, idx, "hosts:role", "web"));
+		CPPUNIT_ASSERT_EQUAL(string("beta"), names(dt, idx, "hosts:role", "db"));
+	}
+
+	/** clte.lookup() returns a sequence of the elements, the same table
+	 * for the same value, and fails for unknown indexes */
+	void lookup()
+	{
+		dir_a.write("data.yaml", document);
+
+		CPPUNIT_ASSERT_EQUAL(string("users,orders,"), render("@$ clte.lookup('schema.tables:owner', 'shop') @.@= @+.name @.,@;", "schema.tables:owner"));
+		CPPUNIT_ASSERT_EQUAL(string("0"), render("@= #clte.lookup('schema.tables:name', 'nothing') @."));
+		CPPUNIT_ASSERT_EQUAL(string("true false"), render("@= rawequal(clte.lookup('schema.tables:name', 'log'), clte.lookup('schema.tables:name', 'log')) @. @= rawequal(clte.lookup('schema.tables:name', 'log'), clte.lookup('schema.tables:name', 'users')) @."));
+		CPPUNIT_ASSERT_THROW(render("@= #clte.lookup('schema.tables:owner', 'shop') @."), std::runtime_error);
+	}
+
+	/// A value shared by many elements still comes back as one sequence
+	void popular()
+	{
+		ostringstream oss;
+
+		for (size_t i = 0; i < 100000; i++) oss << "- { name: e" << i << ", kind: same }\n";
+		dir_a.write("data.yaml", oss.str());
+
+		CPPUNIT_ASSERT_EQUAL(string("100000 e99999"), render("@! all = clte.lookup(':kind', 'same') @;@= #all @. @= all[#all].name @.", ":kind"));
+	}
+};
+
+const char * const IndexCheck::document =
+	"clte-indexes: [ \"schema.tables:name\", \"schema.columns:refs\" ]\n"
+	"schema:\n"
+	"  tables:\n"
+	"    - { name: users, owner: shop }\n"
+	"    - { name: orders, owner: shop }\n"
+	"    - { name: log, owner: ops }\n"
+	"  columns:\n"
+	"    - { name: id }\n"
+	"    - { name: user, refs: users }\n"
+	"    - { name: order_user, refs: [ orders, users, orders ] }\n";
+
+CPPUNIT_TEST_SUITE_REGISTRATION(IndexCheck);
@@ -0,0 +1,182 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <string>
+#include <cppunit/extensions/HelperMacros.h>
+#include "Lua.h"
+#include "Memo.h"
+
+using namespace std;
+using Clte::Lua;
+using Clte::Memo;
+
+/// Checks of memoising pure Lua functions
+class MemoCheck : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(MemoCheck);
+	CPPUNIT_TEST(cached);
+	CPPUNIT_TEST(arguments);
+	CPPUNIT_TEST(numbers);
+	CPPUNIT_TEST(results);
+	CPPUNIT_TEST(bypassed);
+	CPPUNIT_TEST(evicted);
+	CPPUNIT_TEST(cleared);
+	CPPUNIT_TEST(errors);
+	CPPUNIT_TEST_SUITE_END();
+
+	protected:
+	/// Lua state the functions run in
+	Lua lua_a;
+
+	/// Cache under test, small enough to evict
+	Memo memo_a;
+
+	/** Evaluate an expression.
+	 * @param expr_i Lua expression.
+	 * @returns Result converted to a string. */
+	string eval(const string & expr_i)
+	{
+		string res;
+		CPPUNIT_ASSERT_MESSAGE(expr_i, lua_a.eval(expr_i, "check", res));
+		return res;
+	}
+
+	public:
+	/// Constructor
+	MemoCheck()
+	: memo_a(lua_a, 3)
+	{ }
+
+	/// Wrap a counting function and tostring() for every check
+	void setUp() override
+	{
+		CPPUNIT_ASSERT(lua_a.run(
+			"calls = 0\n"
+			"twice = clte.pure(function(x) calls = calls + 1 return x .. x end)\n"
+			"str = clte.pure(function(...) calls = calls + 1 local t = {} "
+			"for i = 1, select('#', ...) do t[i] = tostring((select(i, ...))) end "
+			"return table.concat(t, ',') end)\n", "check"));
+	}
+
+	/// Calls with the same arguments are served from the cache
+	void cached()
+	{
+		CPPUNIT_ASSERT_EQUAL(string("abab"), eval("twice('ab')"));
+		CPPUNIT_ASSERT_EQUAL(string("abab"), eval("twice('ab')"));
+		CPPUNIT_ASSERT_EQUAL(string("1"), eval("calls"));
+		CPPUNIT_ASSERT_EQUAL(uint64_t(1), memo_a.hits());
+		CPPUNIT_ASSERT_EQUAL(uint64_t(1), memo_a.misses());
+		CPPUNIT_ASSERT_EQUAL(size_t(1), memo_a.size());
+	}
+
+	/// Arguments of different types or functions don't share results
+	void arguments()
+	{
+		CPPUNIT_ASSERT_EQUAL(string("1"), eval("str(1)"));
+		CPPUNIT_ASSERT_EQUAL(string("11"), eval("twice(1)"));
+		CPPUNIT_ASSERT_EQUAL(string("nil"), eval("str(nil)"));
+		CPPUNIT_ASSERT_EQUAL(string("false"), eval("str(false)"));
+		CPPUNIT_ASSERT_EQUAL(string(""), eval("str()"));
+		CPPUNIT_ASSERT_EQUAL(string("a,b"), eval("str('a', 'b')"));
+		CPPUNIT_ASSERT_EQUAL(string("ab"), eval("str('ab')"));
+		CPPUNIT_ASSERT_EQUAL(uint64_t(0), memo_a.hits());
+	}
+
+	/// Numbers that print differently get different results
+	void numbers()
+	{
+		CPPUNIT_ASSERT_EQUAL(eval("tostring(1)"), eval("str(1)"));
+		CPPUNIT_ASSERT_EQUAL(eval("tostring(1.0)"), eval("str(1.0)"));
+		CPPUNIT_ASSERT_EQUAL(eval("tostring(0.5)"), eval("str(0.5)"));
+#if LUA_VERSION_NUM >= 503
+		// Integers beyond 2^53 are not rounded to the same float
+		CPPUNIT_ASSERT_EQUAL(string("9007199254740992"), eval("str(math.tointeger(2^53))"));
+		CPPUNIT_ASSERT_EQUAL(string("9007199254740993"), eval("str(math.tointeger(2^53) + 1)"));
+		CPPUNIT_ASSERT(eval("str(1)") != eval("str(1.0)"));
+#endif
+	}
+
+	/// All results are returned again, also nil ones
+	void results()
+	{
+		CPPUNIT_ASSERT(lua_a.run("multi = clte.pure(function(x) return x, nil, x .. '!' end)", "check"));
+		CPPUNIT_ASSERT_EQUAL(string("3 a nil a!"), eval("select('#', multi('a')) .. ' ' .. table.concat({ tostring((multi('a'))), tostring((select(2, multi('a')))), (select(3, multi('a'))) }, ' ')"));
+		CPPUNIT_ASSERT(memo_a.hits() >= 3);
+		CPPUNIT_ASSERT_EQUAL(uint64_t(1), memo_a.misses());
+	}
+
+	/// Calls with tables or functions as argument are not cached
+	void bypassed()
+	{
+		CPPUNIT_ASSERT(lua_a.run("str({}) str({})", "check"));
+		CPPUNIT_ASSERT_EQUAL(string("2"), eval("calls"));
+		CPPUNIT_ASSERT_EQUAL(uint64_t(2), memo_a.bypassed());
+		CPPUNIT_ASSERT_EQUAL(size_t(0), memo_a.size());
+	}
+
+	/// The least recently used result is evicted when the cache is full
+	void evicted()
+	{
+		CPPUNIT_ASSERT(lua_a.run("twice('a') twice('b') twice('c') twice('a') twice('d')", "check"));
+		CPPUNIT_ASSERT_EQUAL(size_t(3), memo_a.size());
+		CPPUNIT_ASSERT_EQUAL(string("4"), eval("calls"));
+
+		// 'b' was evicted, 'a' was used recently enough to stay
+		CPPUNIT_ASSERT(lua_a.run("twice('a')", "check"));
+		CPPUNIT_ASSERT_EQUAL(string("4"), eval("calls"));
+		CPPUNIT_ASSERT_EQUAL(string("bb"), eval("twice('b')"));
+		CPPUNIT_ASSERT_EQUAL(string("5"), eval("calls"));
+	}
+
+	/// Cleared results are calculated again
+	void cleared()
+	{
+		CPPUNIT_ASSERT(lua_a.run("twice('a')", "check"));
+		memo_a.clear();
+		CPPUNIT_ASSERT_EQUAL(size_t(0), memo_a.size());
+		CPPUNIT_ASSERT_EQUAL(string("aa"), eval("twice('a')"));
+		CPPUNIT_ASSERT_EQUAL(string("2"), eval("calls"));
+	}
+
+	/// Errors of wrapped functions reach the caller and are not cached
+	void errors()
+	{
+		CPPUNIT_ASSERT(lua_a.run("fail = clte.pure(function(x) calls = calls + 1 error('no ' .. x) end)", "check"));
+		CPPUNIT_ASSERT(!lua_a.run("fail('a')", "check"));
+		CPPUNIT_ASSERT(!lua_a.run("fail('a')", "check"));
+		CPPUNIT_ASSERT_EQUAL(string("2"), eval("calls"));
+		CPPUNIT_ASSERT_EQUAL(size_t(0), memo_a.size());
+		CPPUNIT_ASSERT_EQUAL(string("true"), eval("not pcall(clte.pure, 'x')"));
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(MemoCheck);
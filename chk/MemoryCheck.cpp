@@ -0,0 +1,124 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <cppunit/extensions/HelperMacros.h>
+#include "Memory.h"
+
+using namespace std;
+using Clte::Memory;
+
+/// Checks of the memory accounting and admission under a limit
+class MemoryCheck : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(MemoryCheck);
+	CPPUNIT_TEST(accounting);
+	CPPUNIT_TEST(admitAlone);
+	CPPUNIT_TEST(admitWaits);
+	CPPUNIT_TEST(admitUnlimited);
+	CPPUNIT_TEST_SUITE_END();
+
+	protected:
+	/// Time to give a thread to get admitted when it shouldn't
+	static constexpr chrono::milliseconds pause{50};
+
+	public:
+	/// Remove the limit again after every check
+	void tearDown() override
+	{
+		Memory::instance()->limit(0);
+	}
+
+	/// Added and released memory is tracked per category and in total
+	void accounting()
+	{
+		Memory * mem = Memory::instance();
+		size_t used = mem->used(), data = mem->used(Memory::data_memory);
+
+		mem->add(Memory::data_memory, 1000);
+		CPPUNIT_ASSERT_EQUAL(used + 1000, mem->used());
+		CPPUNIT_ASSERT_EQUAL(data + 1000, mem->used(Memory::data_memory));
+		CPPUNIT_ASSERT(mem->peak(Memory::data_memory) >= data + 1000);
+
+		mem->limit(used + 500);
+		CPPUNIT_ASSERT(mem->exceeded());
+
+		mem->sub(Memory::data_memory, 1000);
+		CPPUNIT_ASSERT_EQUAL(used, mem->used());
+		CPPUNIT_ASSERT(!mem->exceeded());
+		CPPUNIT_ASSERT(mem->peak() >= used + 1000);
+	}
+
+	/// A single job is admitted even when it is larger than the limit
+	void admitAlone()
+	{
+		Memory::instance()->limit(100);
+		Memory::Admission adm(1000);
+	}
+
+	/// A job that doesn't fit next to a running one waits until it ends
+	void admitWaits()
+	{
+		Memory::instance()->limit(1000);
+		unique_ptr<Memory::Admission> first(new Memory::Admission(800));
+		atomic<bool> admitted(false);
+
+		// A small job still fits
+		{
+			Memory::Admission small(200);
+		}
+
+		thread other([&admitted]() {
+			Memory::Admission adm(300);
+			admitted = true;
+		});
+		this_thread::sleep_for(pause);
+		bool early = admitted;
+
+		// Join before asserting, a failure must not leave it running
+		first.reset();
+		other.join();
+		CPPUNIT_ASSERT(!early);
+		CPPUNIT_ASSERT(admitted);
+	}
+
+	/// Without a limit every job is admitted at once
+	void admitUnlimited()
+	{
+		Memory::Admission first(1000000), second(1000000);
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(MemoryCheck);
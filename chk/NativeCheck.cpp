@@ -0,0 +1,117 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cppunit/extensions/HelperMacros.h>
+#include "Renderer.h"
+#include "Scratch.h"
+
+using namespace std;
+using Clte::Renderer;
+
+/** Checks of templates translated into C++ with clite --emit-cpp. The build
+ * translates chk/sample.clte and compiles the result into the program
+ * SAMPLEBIN, these checks run it and compare its output with the
+ * interpreted render of the same template. */
+class NativeCheck : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(NativeCheck);
+	CPPUNIT_TEST(generated);
+	CPPUNIT_TEST(pipelined);
+	CPPUNIT_TEST(written);
+	CPPUNIT_TEST_SUITE_END();
+
+	protected:
+	/// Directory for the output files
+	Scratch dir_a;
+
+	/** Render the sample template with the interpreter.
+	 * @returns Rendered output. */
+	static string interpreted()
+	{
+		Renderer rnd;
+		ifstream in(SAMPLEDIR "/sample.clte");
+		ostringstream out;
+
+		CPPUNIT_ASSERT(in.good());
+		rnd.in(&in);
+		rnd.out(&out);
+		CPPUNIT_ASSERT(rnd.data(SAMPLEDIR "/sample.yaml"));
+		rnd.render();
+		return out.str();
+	}
+
+	/** Run the generated program on the sample data.
+	 * @param args_i Options to pass before the data file.
+	 * @returns Standard output of the program. */
+	static string run(const string & args_i)
+	{
+		string cmd = string("'" SAMPLEBIN "' ") + args_i + " '" SAMPLEDIR "/sample.yaml'";
+		FILE * pip = popen(cmd.c_str(), "r");
+		string res;
+		char buf[4096];
+		size_t len = 0;
+
+		CPPUNIT_ASSERT(pip != nullptr);
+		while ((len = fread(buf, 1, sizeof(buf), pip)) > 0) res.append(buf, len);
+		CPPUNIT_ASSERT_EQUAL(0, pclose(pip));
+		return res;
+	}
+
+	public:
+	/// The generated program renders like the interpreter
+	void generated()
+	{
+		string exp = interpreted();
+
+		CPPUNIT_ASSERT(exp.find("module app {") != string::npos);
+		CPPUNIT_ASSERT_EQUAL(exp, run(""));
+	}
+
+	/// Pipelined rendering gives the same output
+	void pipelined()
+	{
+		CPPUNIT_ASSERT_EQUAL(interpreted(), run("-p"));
+	}
+
+	/// The output file option writes the same output
+	void written()
+	{
+		CPPUNIT_ASSERT_EQUAL(string(), run("-o '" + dir_a.path("out.txt") + "'"));
+		CPPUNIT_ASSERT_EQUAL(interpreted(), dir_a.read("out.txt"));
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(NativeCheck);
@@ -0,0 +1,151 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <cppunit/extensions/HelperMacros.h>
+#include "Outputs.h"
+#include "Renderer.h"
+#include "Scratch.h"
+
+using namespace std;
+using Clte::Outputs;
+using Clte::Renderer;
+
+/// Checks of rendering into many output files
+class OutputsCheck : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(OutputsCheck);
+	CPPUNIT_TEST(files);
+	CPPUNIT_TEST(reselect);
+	CPPUNIT_TEST(escape);
+	CPPUNIT_TEST(rendered);
+	CPPUNIT_TEST_SUITE_END();
+
+	protected:
+	/// Directory for the output files
+	Scratch dir_a;
+
+	public:
+	/// Files are created in subdirectories as needed
+	void files()
+	{
+		Outputs outs(dir_a.path(""), 16, 2, 2);
+		ostream os(&outs);
+
+		outs.select("top.txt");
+		os << "top";
+		outs.select("sub/deeper/file.txt");
+		os << string(100, 'x');
+		outs.select("sub/other.txt");
+		os << "other";
+		outs.deselect();
+		os << "discarded";
+		CPPUNIT_ASSERT(outs.close());
+
+		CPPUNIT_ASSERT_EQUAL(size_t(3), outs.files());
+		CPPUNIT_ASSERT_EQUAL(string("top"), dir_a.read("top.txt"));
+		CPPUNIT_ASSERT_EQUAL(string(100, 'x'), dir_a.read("sub/deeper/file.txt"));
+		CPPUNIT_ASSERT_EQUAL(string("other"), dir_a.read("sub/other.txt"));
+	}
+
+	/// Selecting a file again appends to it, also after it was written
+	void reselect()
+	{
+		dir_a.write("again.txt", "stale content from an earlier run");
+		Outputs outs(dir_a.path(""), 16, 2, 2);
+		ostream os(&outs);
+
+		outs.select("again.txt");
+		os << string(50, 'a');
+		outs.select("between.txt");
+		os << string(50, 'b');
+		outs.select("again.txt");
+		os << "end";
+		CPPUNIT_ASSERT(outs.close());
+
+		CPPUNIT_ASSERT_EQUAL(size_t(2), outs.files());
+		CPPUNIT_ASSERT_EQUAL(string(50, 'a') + "end", dir_a.read("again.txt"));
+		CPPUNIT_ASSERT_EQUAL(string(50, 'b'), dir_a.read("between.txt"));
+	}
+
+	/** Names that are empty, absolute or lead out of the directory are
+	 * rejected */
+	void escape()
+	{
+		Outputs outs(dir_a.path(""));
+
+		CPPUNIT_ASSERT_THROW(outs.select(""), std::invalid_argument);
+		CPPUNIT_ASSERT_THROW(outs.select("/etc/passwd"), std::invalid_argument);
+		CPPUNIT_ASSERT_THROW(outs.select(".."), std::invalid_argument);
+		CPPUNIT_ASSERT_THROW(outs.select("../outside"), std::invalid_argument);
+		CPPUNIT_ASSERT_THROW(outs.select("sub/../../outside"), std::invalid_argument);
+		CPPUNIT_ASSERT_THROW(outs.select("sub/.."), std::invalid_argument);
+
+		// Dots as part of a name are fine
+		outs.select("..name/file..txt");
+		CPPUNIT_ASSERT(outs.close());
+		CPPUNIT_ASSERT_EQUAL(size_t(1), outs.files());
+	}
+
+	/// Templates switch between output files and the main output
+	void rendered()
+	{
+		Renderer rnd;
+		istringstream in("@! clte.output('gen/a.txt') @;A@! clte.output() @;main@! clte.output('gen/a.txt') @;B");
+		ostringstream out;
+
+		dir_a.write("data.yaml", "{}\n");
+		rnd.in(&in);
+		rnd.out(&out);
+		CPPUNIT_ASSERT(rnd.data(dir_a.path("data.yaml")));
+		CPPUNIT_ASSERT(rnd.outdir(dir_a.path("")));
+		rnd.render();
+
+		CPPUNIT_ASSERT_EQUAL(string("main"), out.str());
+		CPPUNIT_ASSERT_EQUAL(string("AB"), dir_a.read("gen/a.txt"));
+
+		// Escaping the output directory fails the render
+		Renderer bad;
+		istringstream evil("@! clte.output('../evil.txt') @;evil");
+		ostringstream none;
+		bad.in(&evil);
+		bad.out(&none);
+		CPPUNIT_ASSERT(bad.data(dir_a.path("data.yaml")));
+		CPPUNIT_ASSERT(bad.outdir(dir_a.path("")));
+		CPPUNIT_ASSERT_THROW(bad.render(), std::runtime_error);
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(OutputsCheck);
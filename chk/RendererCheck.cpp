@@ -0,0 +1,227 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <cppunit/extensions/HelperMacros.h>
+#include "Renderer.h"
+#include "Scratch.h"
+
+using namespace std;
+using Clte::Renderer;
+
+/// Checks of rendering templates with data
+class RendererCheck : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(RendererCheck);
+	CPPUNIT_TEST(streamed);
+	CPPUNIT_TEST(streamedAlias);
+	CPPUNIT_TEST(streamedCopies);
+	CPPUNIT_TEST(streamedStale);
+	CPPUNIT_TEST(iterated);
+	CPPUNIT_TEST(reuseData);
+	CPPUNIT_TEST(reuseTemplate);
+	CPPUNIT_TEST(reuseLibrary);
+	CPPUNIT_TEST_SUITE_END();
+
+	protected:
+	/// Template iterating with cacheable and uncacheable bodies
+	static const char * const iterations;
+
+	/// Directory for the data files
+	Scratch dir_a;
+
+	/** Render a template once with a fresh renderer.
+	 * @param tpl_i Template.
+	 * @param stream_i True to stream the data file.
+	 * @returns Rendered output. */
+	string render(const string & tpl_i, const bool stream_i = false)
+	{
+		Renderer rnd;
+		istringstream in(tpl_i);
+		ostringstream out;
+
+		rnd.in(&in);
+		rnd.out(&out);
+		CPPUNIT_ASSERT(rnd.data(dir_a.path("data.yaml"), stream_i));
+		rnd.render();
+		return out.str();
+	}
+
+	/** Render again with a renderer reusing fragments, like a watch cycle,
+	 * and compare the output with a fresh render.
+	 * @param rnd_io Renderer that rendered before.
+	 * @param tpl_i Template to render.
+	 * @param changed_i True if the template changed.
+	 * @returns Rendered output. */
+	string again(Renderer & rnd_io, const string & tpl_i, const bool changed_i)
+	{
+		istringstream in(tpl_i);
+		ostringstream out;
+
+		rnd_io.rerender(&out, changed_i ? &in : nullptr, true);
+		CPPUNIT_ASSERT_EQUAL(render(tpl_i), out.str());
+		return out.str();
+	}
+
+	public:
+	/// Streamed elements render like a loaded document
+	void streamed()
+	{
+		dir_a.write("data.yaml", "- { name: a, size: 1 }\n- b\n- { name: c, size: 3, same: &s x, again: *s }\n");
+		string tpl("@$ data @.[@? type(@+) == 'string' @.@= @+ @.@:@= @+.name @.=@= @+.size @.@;]@;");
+
+		CPPUNIT_ASSERT_EQUAL(string("[a=1][b][c=3]"), render(tpl, true));
+		CPPUNIT_ASSERT_EQUAL(render(tpl), render(tpl, true));
+	}
+
+	/// An alias to an anchor of an earlier element can't be streamed
+	void streamedAlias()
+	{
+		dir_a.write("data.yaml", "- &first { name: a }\n- *first\n");
+		string tpl("@$ data @.@= @+.name @.@;");
+
+		CPPUNIT_ASSERT_EQUAL(string("aa"), render(tpl));
+		CPPUNIT_ASSERT_THROW(render(tpl, true), std::runtime_error);
+	}
+
+	/// Values copied out of a streamed element stay available
+	void streamedCopies()
+	{
+		dir_a.write("data.yaml", "- { name: a }\n- { name: b }\n");
+		string tpl("@! names = '' @;@$ data @.@! names = names .. @+.name @;@;@= names @.");
+
+		CPPUNIT_ASSERT_EQUAL(string("ab"), render(tpl, true));
+	}
+
+	/** A streamed element kept beyond its iteration is an error instead of
+	 * a dangling reference into released memory */
+	void streamedStale()
+	{
+		dir_a.write("data.yaml", "- { name: a }\n- { name: b }\n");
+		string tpl("@$ data @.@! kept = @+ @;@;@= kept.name @.");
+
+		CPPUNIT_ASSERT_THROW(render(tpl, true), std::runtime_error);
+	}
+
+	/** Iterations walk maps in document order, with keys and values of
+	 * outer iterations available */
+	void iterated()
+	{
+		dir_a.write("data.yaml", "z: { b: 1, a: 2 }\ny: [ p, q ]\nx: ~\n");
+
+		CPPUNIT_ASSERT_EQUAL(string("z(b=1,a=2,)y(1=p,2=q,)x()"), render("@$ data @.@^(@$ @+ @.@^=@+,@;)@;"));
+		CPPUNIT_ASSERT_EQUAL(string("z.b z.a y.1 y.2 "), render("@$ data @.@$ @+ @.@^^.@^ @;@;"));
+		CPPUNIT_ASSERT_EQUAL(string("b=1;a=2;"), render("@$ data.z @.@= clte.key(1) .. '=' .. clte.value(1) @.;@;"));
+	}
+
+	/** Fragments of unchanged elements are reused while changed, added
+	 * and removed elements show up */
+	void reuseData()
+	{
+		Renderer rnd;
+		istringstream in(iterations);
+		ostringstream out;
+
+		dir_a.write("data.yaml", "items:\n- { name: a, size: 1 }\n- { name: b, size: 2 }\n- { name: c, size: 3 }\n");
+		rnd.fragments(true);
+		rnd.in(&in);
+		rnd.out(&out);
+		CPPUNIT_ASSERT(rnd.data(dir_a.path("data.yaml")));
+		rnd.render();
+		CPPUNIT_ASSERT_EQUAL(render(iterations), out.str());
+
+		// Unchanged
+		again(rnd, iterations, false);
+
+		// One element changed, one added
+		dir_a.write("data.yaml", "items:\n- { name: a, size: 1 }\n- { name: b, size: 5 }\n- { name: c, size: 3 }\n- { name: d, size: 4 }\n");
+		again(rnd, iterations, false);
+
+		// Elements swapped and one removed
+		dir_a.write("data.yaml", "items:\n- { name: c, size: 3 }\n- { name: a, size: 1 }\n");
+		string res = again(rnd, iterations, false);
+		CPPUNIT_ASSERT(res.find("<c:3>") < res.find("<a:1>"));
+		CPPUNIT_ASSERT(res.find("<b:") == string::npos);
+
+		// Equal elements at different positions
+		dir_a.write("data.yaml", "items:\n- { name: a, size: 1 }\n- { name: a, size: 1 }\n");
+		again(rnd, iterations, false);
+	}
+
+	/** Fragments survive a template change elsewhere, and a changed body
+	 * is rendered again */
+	void reuseTemplate()
+	{
+		Renderer rnd;
+		istringstream in(iterations);
+		ostringstream out;
+
+		dir_a.write("data.yaml", "items:\n- { name: a, size: 1 }\n- { name: b, size: 2 }\n");
+		rnd.fragments(true);
+		rnd.in(&in);
+		rnd.out(&out);
+		CPPUNIT_ASSERT(rnd.data(dir_a.path("data.yaml")));
+		rnd.render();
+
+		again(rnd, string("Header\n") + iterations, true);
+		again(rnd, "@$ data.items @.<@= @+.name @.-@= @+.size @.>@;", true);
+		again(rnd, iterations, true);
+	}
+
+	/// Replacing a library function used by cached bodies stops reuse
+	void reuseLibrary()
+	{
+		Renderer rnd;
+		istringstream in(iterations);
+		ostringstream out;
+
+		dir_a.write("data.yaml", "items:\n- { name: a, size: 1 }\n- { name: b, size: 2 }\n");
+		rnd.fragments(true);
+		rnd.in(&in);
+		rnd.out(&out);
+		CPPUNIT_ASSERT(rnd.data(dir_a.path("data.yaml")));
+		rnd.render();
+
+		string res = again(rnd, string("@! string.upper = string.lower @;") + iterations, true);
+		CPPUNIT_ASSERT(res.find("(A)") == string::npos);
+	}
+};
+
+const char * const RendererCheck::iterations =
+	"@$ data.items @.<@= @+.name @.:@= @+.size @.>@;\n"
+	"@$ data.items @.(@= string.upper(@+.name) @.)@;\n"
+	"@$ data.items @.@! last = @+.name @;@= last @.@;\n"
+	"@$ data.items @.@$ @+ @.@= @^ @.=@= @+ @.;@;@;\n";
+
+CPPUNIT_TEST_SUITE_REGISTRATION(RendererCheck);
@@ -0,0 +1,75 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <ftw.h>
+#include "Scratch.h"
+
+Scratch::Scratch()
+{
+	const char * tmp = getenv("TMPDIR");
+	std::string tpl = std::string(tmp != nullptr && *tmp != '\0' ? tmp : "/tmp") + "/clte-chk-XXXXXX";
+
+	if (mkdtemp(&tpl[0]) == nullptr) throw std::runtime_error("Unable to create " + tpl);
+	dir_a = tpl;
+}
+
+Scratch::~Scratch()
+{
+	// Remove the contents before the directories containing them
+	nftw(dir_a.c_str(), [](const char * path_i, const struct stat *, int, struct FTW *) { return remove(path_i); },
+		16, FTW_DEPTH | FTW_PHYS);
+}
+
+std::string Scratch::path(const std::string & name_i) const
+{
+	return dir_a + "/" + name_i;
+}
+
+std::string Scratch::read(const std::string & name_i) const
+{
+	std::ifstream ifs(path(name_i), std::ios::binary);
+	std::ostringstream oss;
+
+	oss << ifs.rdbuf();
+	return oss.str();
+}
+
+void Scratch::write(const std::string & name_i, const std::string & content_i) const
+{
+	std::ofstream ofs(path(name_i), std::ios::binary | std::ios::trunc);
+	ofs << content_i;
+}
@@ -0,0 +1,71 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#pragma once
+
+#include <string>
+
+/** Temporary directory for the files of a single check, removed again with
+ * everything in it when the instance goes out of scope. */
+class Scratch
+{
+	protected:
+	// Path of the directory
+	std::string dir_a;
+
+	public:
+	/** Constructor, creates a new directory below $TMPDIR or /tmp.
+	 * @throws std::runtime_error when the directory can't be created. */
+	Scratch();
+
+	// Copying would remove the directory twice
+	Scratch(const Scratch & obj_i) = delete;
+	Scratch & operator=(const Scratch & obj_i) = delete;
+
+	// Destructor, removes the directory and everything in it
+	~Scratch();
+
+	/** Get the path of a file in the directory.
+	 * @param name_i Name of the file.
+	 * @returns Path of the file. */
+	std::string path(const std::string & name_i) const;
+
+	/** Read a whole file.
+	 * @param name_i Name of the file in the directory.
+	 * @returns Content of the file, empty if it doesn't exist. */
+	std::string read(const std::string & name_i) const;
+
+	/** Create or replace a file.
+	 * @param name_i Name of the file in the directory.
+	 * @param content_i Content to write. */
+	void write(const std::string & name_i, const std::string & content_i) const;
+};
@@ -0,0 +1,140 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <cppunit/extensions/HelperMacros.h>
+#include "Driver.h"
+#include "Template.h"
+
+using namespace std;
+using Clte::Driver;
+namespace Emit = Clte::Emit;
+using Clte::Template;
+
+/// Checks of merging literal text when compiling templates
+class TemplateCheck : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(TemplateCheck);
+	CPPUNIT_TEST(merge);
+	CPPUNIT_TEST(mergeBlocks);
+	CPPUNIT_TEST(parsed);
+	CPPUNIT_TEST_SUITE_END();
+
+	protected:
+	/** Append a literal node to a list.
+	 * @param tpl_io Template to allocate the node in.
+	 * @param list_i List to append to.
+	 * @param text_i Literal text.
+	 * @returns Extended list. */
+	static Template::List literal(Template & tpl_io, const Template::List & list_i, const string & text_i)
+	{
+		return Template::append(list_i, tpl_io.node(Template::literal_node, 1, tpl_io.copy(text_i)));
+	}
+
+	public:
+	/// Adjacent literals become one node, other nodes stay in between
+	void merge()
+	{
+		Template tpl("check");
+		Template::List lst = { nullptr, nullptr };
+
+		lst = literal(tpl, lst, "a");
+		lst = literal(tpl, lst, "b");
+		lst = literal(tpl, lst, "c");
+		lst = Template::append(lst, tpl.node(Template::output_node, 1, tpl.copy("x")));
+		lst = literal(tpl, lst, string(100, 'd'));
+		lst = literal(tpl, lst, "e");
+		tpl.root(lst.head);
+
+		CPPUNIT_ASSERT_EQUAL(size_t(3), tpl.merge());
+		const Template::Node * nd = tpl.root();
+		CPPUNIT_ASSERT(nd->text == "abc");
+		CPPUNIT_ASSERT(nd->emit == Emit::classify(3));
+		nd = nd->next;
+		CPPUNIT_ASSERT(nd->type == Template::output_node);
+		nd = nd->next;
+		CPPUNIT_ASSERT(nd->text == string(100, 'd') + "e");
+		CPPUNIT_ASSERT(nd->emit == Emit::classify(101));
+		CPPUNIT_ASSERT(nd->next == nullptr);
+
+		// Merging again finds nothing left to merge
+		CPPUNIT_ASSERT_EQUAL(size_t(0), tpl.merge());
+	}
+
+	/// Literals are merged inside blocks, but not across block ends
+	void mergeBlocks()
+	{
+		Template tpl("check");
+		Template::List body = { nullptr, nullptr }, alt = { nullptr, nullptr }, lst = { nullptr, nullptr };
+
+		body = literal(tpl, body, "then");
+		body = literal(tpl, body, " branch");
+		alt = literal(tpl, alt, "else");
+		alt = literal(tpl, alt, " branch");
+		Template::Node * cond = tpl.node(Template::if_node, 1, tpl.copy("true"));
+		cond->body = body.head;
+		cond->alt = alt.head;
+		lst = literal(tpl, lst, "before");
+		lst = Template::append(lst, cond);
+		lst = literal(tpl, lst, "after");
+		tpl.root(lst.head);
+
+		CPPUNIT_ASSERT_EQUAL(size_t(2), tpl.merge());
+		CPPUNIT_ASSERT(cond->body->text == "then branch" && cond->body->next == nullptr);
+		CPPUNIT_ASSERT(cond->alt->text == "else branch" && cond->alt->next == nullptr);
+		CPPUNIT_ASSERT(tpl.root()->text == "before");
+		CPPUNIT_ASSERT(cond->next->text == "after");
+	}
+
+	/// Comments, indentation tabs and escaped at signs don't split the
+	/// literal text of a parsed template
+	void parsed()
+	{
+		Driver drv;
+		istringstream in("one @# comment\n\t@\ttwo @@ three\nfour@= 1 @.five\n");
+
+		CPPUNIT_ASSERT(drv.parse(in, "check"));
+		unique_ptr<Template> tpl = drv.release();
+		const Template::Node * nd = tpl->root();
+
+		CPPUNIT_ASSERT(nd != nullptr && nd->type == Template::literal_node);
+		CPPUNIT_ASSERT_EQUAL(string("one \ttwo @ three\nfour"), string(nd->text));
+		nd = nd->next;
+		CPPUNIT_ASSERT(nd != nullptr && nd->type == Template::output_node);
+		nd = nd->next;
+		CPPUNIT_ASSERT(nd != nullptr && nd->text == "five\n" && nd->next == nullptr);
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TemplateCheck);
@@ -0,0 +1,142 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <ostream>
+#include <string>
+#include <sys/stat.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include "Scratch.h"
+#include "UpdateBuf.h"
+
+using namespace std;
+using Clte::UpdateBuf;
+
+/// Checks of only writing output files that changed
+class UpdateBufCheck : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(UpdateBufCheck);
+	CPPUNIT_TEST(created);
+	CPPUNIT_TEST(unchanged);
+	CPPUNIT_TEST(changed);
+	CPPUNIT_TEST(shorter);
+	CPPUNIT_TEST(longer);
+	CPPUNIT_TEST_SUITE_END();
+
+	protected:
+	/// Content of the existing file, longer than a comparison chunk
+	static const string content;
+
+	/// Directory for the output files
+	Scratch dir_a;
+
+	/** Get the inode number of a file, which changes when it is replaced.
+	 * @param name_i Name of the file.
+	 * @returns Inode number. */
+	ino_t inode(const string & name_i)
+	{
+		struct stat st;
+		CPPUNIT_ASSERT(stat(dir_a.path(name_i).c_str(), &st) == 0);
+		return st.st_ino;
+	}
+
+	/** Write output through an UpdateBuf with small chunks.
+	 * @param name_i Name of the file.
+	 * @param out_i Output to write.
+	 * @returns True if the file was replaced. */
+	bool update(const string & name_i, const string & out_i)
+	{
+		UpdateBuf buf(dir_a.path(name_i), 16);
+		ostream os(&buf);
+
+		os << out_i;
+		CPPUNIT_ASSERT(os.good());
+		CPPUNIT_ASSERT(buf.close());
+		return buf.changed();
+	}
+
+	public:
+	/// A file that doesn't exist yet is created
+	void created()
+	{
+		CPPUNIT_ASSERT(update("new", content));
+		CPPUNIT_ASSERT(dir_a.read("new") == content);
+	}
+
+	/// Identical output leaves the existing file alone
+	void unchanged()
+	{
+		dir_a.write("out", content);
+		ino_t ino = inode("out");
+
+		CPPUNIT_ASSERT(!update("out", content));
+		CPPUNIT_ASSERT(dir_a.read("out") == content);
+		CPPUNIT_ASSERT_EQUAL(ino, inode("out"));
+	}
+
+	/// Output differing after the first chunks replaces the file
+	void changed()
+	{
+		string other(content);
+		other[other.size() - 3] = '!';
+		dir_a.write("out", content);
+		ino_t ino = inode("out");
+
+		CPPUNIT_ASSERT(update("out", other));
+		CPPUNIT_ASSERT(dir_a.read("out") == other);
+		CPPUNIT_ASSERT(ino != inode("out"));
+	}
+
+	/// Output that is a prefix of the existing file replaces it
+	void shorter()
+	{
+		dir_a.write("out", content);
+		CPPUNIT_ASSERT(update("out", content.substr(0, 40)));
+		CPPUNIT_ASSERT(dir_a.read("out") == content.substr(0, 40));
+	}
+
+	/// Output extending the existing file replaces it
+	void longer()
+	{
+		dir_a.write("out", content);
+		CPPUNIT_ASSERT(update("out", content + "more"));
+		CPPUNIT_ASSERT(dir_a.read("out") == content + "more");
+	}
+};
+
+const string UpdateBufCheck::content =
+	"int main()\n"
+	"{\n"
+	"\treturn 0;\n"
+	"}\n"
+	"// Generated, do not edit\n";
+
+CPPUNIT_TEST_SUITE_REGISTRATION(UpdateBufCheck);
@@ -0,0 +1,176 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include "IoWriter.h"
+#include "Scratch.h"
+
+using namespace std;
+using Clte::IoWriter;
+using Clte::PoolWriter;
+
+/// Checks of the output file writer backends
+class WriterCheck : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(WriterCheck);
+	CPPUNIT_TEST(interleaved);
+	CPPUNIT_TEST(reopened);
+	CPPUNIT_TEST(truncated);
+	CPPUNIT_TEST(failedOpen);
+	CPPUNIT_TEST_SUITE_END();
+
+	protected:
+	/// Directory for the output files
+	Scratch dir_a;
+
+	/** Get all backends available on this machine.
+	 * @returns Backends, the thread pool first. */
+	static vector<unique_ptr<IoWriter> > backends()
+	{
+		vector<unique_ptr<IoWriter> > res;
+
+		res.emplace_back(new PoolWriter(2));
+#ifdef HAVE_LIBURING
+		unique_ptr<Clte::UringWriter> uring(new Clte::UringWriter());
+		if (uring->ok()) res.emplace_back(std::move(uring));
+#endif
+		return res;
+	}
+
+	/** Describe a file that wasn't written yet.
+	 * @param name_i Name of the file in the directory.
+	 * @param index_i Index in the set of files.
+	 * @returns File. */
+	IoWriter::File file(const string & name_i, const size_t index_i)
+	{
+		return IoWriter::File{ dir_a.path(name_i), index_i, -1, -1, false, 0 };
+	}
+
+	/** Describe a job.
+	 * @param fil_i File to write to.
+	 * @param data_i Output to write.
+	 * @param close_i True to close the file afterwards.
+	 * @returns Job. */
+	static IoWriter::Job job(IoWriter::File & fil_i, const string & data_i, const bool close_i)
+	{
+		return IoWriter::Job{ &fil_i, close_i, vector<char>(data_i.begin(), data_i.end()) };
+	}
+
+	public:
+	/** Jobs of different files interleaved in one batch stay in order
+	 * per file */
+	void interleaved()
+	{
+		for (unique_ptr<IoWriter> & wrt : backends()) {
+			IoWriter::File a = file(string("a-") + wrt->name(), 0), b = file(string("b-") + wrt->name(), 1);
+			vector<IoWriter::Job> jobs;
+
+			jobs.push_back(job(a, "1", false));
+			jobs.push_back(job(b, "x", false));
+			jobs.push_back(job(a, "2", false));
+			jobs.push_back(job(b, "y", true));
+			jobs.push_back(job(a, "3", false));
+			jobs.push_back(job(a, "", true));
+			CPPUNIT_ASSERT_MESSAGE(wrt->name(), wrt->write(jobs));
+
+			CPPUNIT_ASSERT_EQUAL(string("123"), dir_a.read(string("a-") + wrt->name()));
+			CPPUNIT_ASSERT_EQUAL(string("xy"), dir_a.read(string("b-") + wrt->name()));
+			CPPUNIT_ASSERT(a.created && b.created);
+			CPPUNIT_ASSERT_EQUAL(uint64_t(3), a.size);
+		}
+	}
+
+	/** A file closed and opened again is appended to, in one batch and
+	 * across batches */
+	void reopened()
+	{
+		for (unique_ptr<IoWriter> & wrt : backends()) {
+			IoWriter::File a = file(wrt->name(), 0);
+			vector<IoWriter::Job> jobs;
+
+			jobs.push_back(job(a, "one", true));
+			jobs.push_back(job(a, "two", true));
+			CPPUNIT_ASSERT_MESSAGE(wrt->name(), wrt->write(jobs));
+			jobs.clear();
+			jobs.push_back(job(a, "three", true));
+			CPPUNIT_ASSERT_MESSAGE(wrt->name(), wrt->write(jobs));
+
+			CPPUNIT_ASSERT_EQUAL(string("onetwothree"), dir_a.read(wrt->name()));
+		}
+	}
+
+	/// Content of an earlier run is replaced
+	void truncated()
+	{
+		for (unique_ptr<IoWriter> & wrt : backends()) {
+			IoWriter::File a = file(wrt->name(), 0);
+			vector<IoWriter::Job> jobs;
+
+			dir_a.write(wrt->name(), "stale content of an earlier run");
+			jobs.push_back(job(a, "new", true));
+			CPPUNIT_ASSERT_MESSAGE(wrt->name(), wrt->write(jobs));
+			CPPUNIT_ASSERT_EQUAL(string("new"), dir_a.read(wrt->name()));
+		}
+	}
+
+	/// A failed open is reported and the next attempt still truncates
+	void failedOpen()
+	{
+		for (unique_ptr<IoWriter> & wrt : backends()) {
+			IoWriter::File a = file(wrt->name(), 0), b = file(string("b-") + wrt->name(), 1);
+			vector<IoWriter::Job> jobs;
+
+			// A directory can't be opened for writing
+			CPPUNIT_ASSERT(mkdir(a.path.c_str(), 0777) == 0);
+			jobs.push_back(job(a, "lost", true));
+			jobs.push_back(job(b, "fine", true));
+			CPPUNIT_ASSERT_MESSAGE(wrt->name(), !wrt->write(jobs));
+			CPPUNIT_ASSERT(!a.created);
+			CPPUNIT_ASSERT_EQUAL(string("fine"), dir_a.read(string("b-") + wrt->name()));
+
+			CPPUNIT_ASSERT(rmdir(a.path.c_str()) == 0);
+			dir_a.write(wrt->name(), "stale");
+			a.size = 0;
+			jobs.clear();
+			jobs.push_back(job(a, "new", true));
+			CPPUNIT_ASSERT_MESSAGE(wrt->name(), wrt->write(jobs));
+			CPPUNIT_ASSERT_EQUAL(string("new"), dir_a.read(wrt->name()));
+		}
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(WriterCheck);
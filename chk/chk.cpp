@@ -35,7 +35,8 @@
 #endif
 #include <iostream>
 #include <string.h>
-#include <globals.h>
+#include "commondefs.h"
+#include "Logger.h"
 #include <cppunit/extensions/TestFactoryRegistry.h>
 #include <cppunit/ui/text/TestRunner.h>
 
@@ -46,7 +47,7 @@ using namespace std;
 int main(int argc, char *argv[])
 {
 	UNUSED(argc);
-	Fs2a::Logger::instance()->open(basename(argv[0]), LOG_LOCAL0, strlen(REPOROOT) + 1);
+	Fs2a::Logger::instance()->syslog(basename(argv[0]), LOG_LOCAL0, strlen(STR(REPOROOT)) + 1);
 
 	CppUnit::TextUi::TestRunner runner;
 	bool retval = false;
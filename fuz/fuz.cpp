@@ -0,0 +1,404 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <unistd.h>
+#include "Data.h"
+#include "Driver.h"
+#include "Logger.h"
+#include "Renderer.h"
+
+/** Fuzzing harness for the template scanner, parser and renderer. Every
+ * input is used as a template and rendered along all execution paths:
+ * with YAML data, with precompiled data, pipelined, and again with reused
+ * output fragments. All paths must agree on success and produce
+ * byte-identical output. Streaming a sequence of elements must give the
+ * same result pipelined or not. Parsing and rendering the input twice in
+ * a row, and parsing it twice inside a single expression, must also take
+ * about twice as long as the input once, to catch superlinear behaviour
+ * like long runs of @^^^^ or @++++ or many tags in one expression.
+ *
+ * Built with CLTE_FUZZ_DATA, the input instead mutates a precompiled
+ * data image, which must be rejected or load, hash and render without
+ * crashing.
+ *
+ * Built with clang, this is a libFuzzer target. Otherwise it runs all
+ * files given on the command line, for AFL or for replaying a corpus. */
+
+using namespace std;
+
+namespace
+{
+
+	/// True to fuzz precompiled data images instead of templates
+#ifdef CLTE_FUZZ_DATA
+	constexpr bool images = true;
+#else
+	constexpr bool images = false;
+#endif
+
+	/// Data document all templates are rendered with
+	const char document[] =
+		"name: fuzz\n"
+		"items: [ a, b, c ]\n"
+		"map: { one: 1, two: 2, three: { x: y } }\n"
+		"list:\n"
+		"  - { name: first, type: int }\n"
+		"  - { name: second, type: text, empty: ~ }\n";
+
+	/// Data document streamed one element at a time
+	const char elements[] =
+		"- { name: first, items: [ a, b ] }\n"
+		"- second\n"
+		"- { name: third, map: { x: y }, empty: ~ }\n";
+
+	/// Template visiting every node of a data document
+	const char walker[] =
+		"@! local function walk(v, d) if d < 64 and type(v) == 'userdata' then "
+		"for k, x in pairs(v) do walk(x, d + 1) end end end walk(data, 0) @;"
+		"@= #data @.@$ data @.@^=@+,@;";
+
+	/// Maximum growth of the time taken when doubling the input
+	constexpr double superlinear = 4.0;
+
+	/// Doubled inputs faster than this are too noisy to judge, in seconds
+	constexpr double mintime = 0.01;
+
+	/// Lua instructions allowed per render, in steps of 1000
+	constexpr size_t maxsteps = 1000;
+
+	// Data files with the document as YAML and precompiled, and with the
+	// streamed elements
+	string yamlfile, cltedfile, streamfile;
+
+	// Precompiled image of the document
+	string image;
+
+	// Lua instruction steps left in the current render
+	size_t steps = 0;
+
+	/// Outcome of a render
+	struct Result {
+		bool ok;     ///< True if successful
+		string out;  ///< Output, only complete when successful
+		double time; ///< Time taken in seconds
+	};
+
+	/** Report a failed check and abort, so the fuzzer keeps the input.
+	 * @param what_i Description of the failure.
+	 * @param tpl_i Template that failed. */
+	[[noreturn]] void fail(const string & what_i, const string & tpl_i)
+	{
+		cerr << "FAILED: " << what_i << endl << "Template (" << tpl_i.size() << " bytes):" << endl << tpl_i << endl;
+		abort();
+	}
+
+	/// Lua count hook, stops templates that would run forever
+	void hook(lua_State * L, lua_Debug * ar_i)
+	{
+		UNUSED(ar_i);
+		if (steps == 0) luaL_error(L, "instruction limit reached");
+		steps--;
+	}
+
+	/** Remove the addresses Lua prints for tables, proxies and functions,
+	 * which differ between renders.
+	 * @param out_i Rendered output.
+	 * @returns Output without addresses. */
+	string normalize(const string & out_i)
+	{
+		static const regex address("(table|userdata|function|thread): (0x)?[0-9a-fA-F]+");
+		return regex_replace(out_i, address, "$1");
+	}
+
+	/** Time how long parsing a template takes, best of three.
+	 * @param tpl_i Template to parse.
+	 * @returns Time in seconds. */
+	double parse(const string & tpl_i)
+	{
+		double best = 0;
+
+		for (int i = 0; i < 3; i++) {
+			istringstream in(tpl_i);
+			Clte::Driver drv;
+			auto start = chrono::steady_clock::now();
+			drv.parse(in, "fuzz");
+			chrono::duration<double> dur = chrono::steady_clock::now() - start;
+			if (i == 0 || dur.count() < best) best = dur.count();
+		}
+
+		return best;
+	}
+
+	/** Keep renders bounded in time and memory.
+	 * @param rnd_i Renderer to limit. */
+	void limit(Clte::Renderer & rnd_i)
+	{
+		lua_sethook(rnd_i.lua().state(), &hook, LUA_MASKCOUNT, 1000);
+#ifdef LUAJIT_VERSION
+		// Compiled traces don't call hooks
+		luaJIT_setmode(rnd_i.lua().state(), 0, LUAJIT_MODE_ENGINE | LUAJIT_MODE_OFF);
+#endif
+		rnd_i.lua().run("string.rep = nil", "fuzz");
+	}
+
+	/** Render a template.
+	 * @param tpl_i Template to render.
+	 * @param data_i Data file to use.
+	 * @param pipelined_i True to render pipelined.
+	 * @param stream_i True to stream the data file.
+	 * @returns Outcome of the render. */
+	Result render(const string & tpl_i, const string & data_i, const bool pipelined_i, const bool stream_i = false)
+	{
+		Result res{ false, string(), 0 };
+		istringstream in(tpl_i);
+		ostringstream out;
+		Clte::Renderer rnd;
+
+		steps = maxsteps;
+		limit(rnd);
+
+		auto start = chrono::steady_clock::now();
+		try {
+			rnd.pipelined(pipelined_i);
+			if (rnd.data(data_i, stream_i)) {
+				rnd.in(&in, "fuzz");
+				rnd.out(&out);
+				rnd.render();
+				res.ok = true;
+			}
+		} catch (const exception &) {
+			res.ok = false;
+		}
+		chrono::duration<double> dur = chrono::steady_clock::now() - start;
+		res.time = dur.count();
+		res.out = normalize(out.str());
+		return res;
+	}
+
+	/** Render a template with output fragments enabled, then render it
+	 * again unchanged and after reloading the data, reusing fragments.
+	 * @param tpl_i Template to render.
+	 * @returns Outcomes of the three renders. */
+	vector<Result> reuse(const string & tpl_i)
+	{
+		vector<Result> res(3, Result{ false, string(), 0 });
+		istringstream in(tpl_i);
+		ostringstream out;
+		Clte::Renderer rnd;
+
+		limit(rnd);
+		rnd.fragments(true);
+		for (size_t i = 0; i < res.size(); i++) {
+			ostringstream again;
+			steps = maxsteps;
+			try {
+				if (i == 0) {
+					if (!rnd.data(yamlfile)) break;
+					rnd.in(&in, "fuzz");
+					rnd.out(&out);
+					rnd.render();
+				} else {
+					rnd.rerender(&again, nullptr, i == 2);
+				}
+				res[i].ok = true;
+			} catch (const exception &) {
+				break;
+			}
+			res[i].out = normalize(i == 0 ? out.str() : again.str());
+		}
+
+		return res;
+	}
+
+	/** Write a data file into a temporary file.
+	 * @param data_i Content of the file.
+	 * @param size_i Size of the content.
+	 * @returns Name of the file. */
+	string temporary(const char * data_i, const size_t size_i)
+	{
+		char name[] = "/tmp/clte-fuzz-XXXXXX";
+		int fd = mkstemp(name);
+		if (fd < 0) fail("Unable to create data file", string());
+		if (write(fd, data_i, size_i) != static_cast<ssize_t>(size_i)) fail("Unable to write data file", string());
+		close(fd);
+		return name;
+	}
+
+	/** Write the data documents to temporary files, once. */
+	void setup()
+	{
+		if (!yamlfile.empty()) return;
+
+		yamlfile = temporary(document, sizeof(document) - 1);
+		streamfile = temporary(elements, sizeof(elements) - 1);
+		cltedfile = yamlfile + ".clted";
+
+		Clte::Data dt;
+		if (!dt.yaml(yamlfile) || !dt.save(cltedfile)) fail("Unable to precompile data file", string());
+		ifstream ifs(cltedfile, ios::binary);
+		image.assign(istreambuf_iterator<char>(ifs), istreambuf_iterator<char>());
+		atexit([]() {
+			unlink(yamlfile.c_str());
+			unlink(cltedfile.c_str());
+			unlink(streamfile.c_str());
+		});
+	}
+
+	/** Run all checks on a single input.
+	 * @param tpl_i Input used as template. */
+	void check(const string & tpl_i)
+	{
+		Result dir = render(tpl_i, yamlfile, false);
+		Result pre = render(tpl_i, cltedfile, false);
+		Result pip = render(tpl_i, yamlfile, true);
+
+		if (dir.ok != pre.ok || dir.ok != pip.ok) fail("Execution paths disagree on success", tpl_i);
+		if (dir.ok && pre.out != dir.out) fail("Output differs with precompiled data", tpl_i);
+		if (dir.ok && pip.out != dir.out) fail("Output differs when pipelined", tpl_i);
+
+		vector<Result> frg = reuse(tpl_i);
+		for (const Result & res : frg) {
+			if (res.ok != dir.ok) fail("Execution paths disagree on success with output fragments", tpl_i);
+			if (dir.ok && res.out != dir.out) fail("Output differs with output fragments", tpl_i);
+		}
+
+		Result str = render(tpl_i, streamfile, false, true);
+		Result stp = render(tpl_i, streamfile, true, true);
+		if (str.ok != stp.ok) fail("Streaming paths disagree on success", tpl_i);
+		if (str.ok && stp.out != str.out) fail("Output differs when streaming pipelined", tpl_i);
+
+		string twice = tpl_i + tpl_i;
+		double once = parse(tpl_i), dbl = parse(twice);
+		if (dbl > mintime && dbl > superlinear * once) fail("Parse time grows superlinearly", tpl_i);
+
+		// The parser joins all tags inside an expression
+		once = parse("@= " + tpl_i + " @.");
+		dbl = parse("@= " + twice + " @.");
+		if (dbl > mintime && dbl > superlinear * once) fail("Parse time grows superlinearly within an expression", tpl_i);
+
+		// Only templates that render completely say something about growth
+		if (!dir.ok) return;
+		Result rdbl = render(twice, yamlfile, false);
+		if (rdbl.ok && rdbl.time > mintime && rdbl.time > superlinear * min(dir.time, pre.time)) {
+			fail("Render time grows superlinearly", tpl_i);
+		}
+	}
+
+	/** Mutate the precompiled image and load, hash and render it. The
+	 * input is a list of 5-byte records, a 32-bit offset into the image
+	 * and a byte to XOR there. Remaining bytes cut that many 8-byte words
+	 * off the end. The checksum is fixed up afterwards, so the mutations
+	 * reach the validation of the image.
+	 * @param in_i Input with the mutations. */
+	void mutate(const string & in_i)
+	{
+		string img(image);
+		size_t recs = in_i.size() / 5;
+
+		for (size_t i = 0; i < recs; i++) {
+			uint32_t off;
+			memcpy(&off, in_i.data() + 5 * i, sizeof(off));
+			img[off % img.size()] ^= in_i[5 * i + 4];
+		}
+		for (size_t i = 5 * recs; i < in_i.size() && img.size() > sizeof(Clte::Data::Header); i++) {
+			size_t cut = 8 * static_cast<unsigned char>(in_i[i]);
+			img.resize(max(img.size() - min(img.size(), cut), sizeof(Clte::Data::Header)));
+		}
+
+		Clte::Data::Header hdr;
+		memcpy(&hdr, img.data(), sizeof(hdr));
+		hdr.checksum = Clte::Data::checksum(img.data() + sizeof(hdr), (img.size() - sizeof(hdr)) & ~static_cast<size_t>(7));
+		memcpy(&img[0], &hdr, sizeof(hdr));
+		string file = temporary(img.data(), img.size());
+
+		// Anything that loads must be safe to walk, also through aliases
+		Clte::Data dt;
+		if (dt.load(file)) {
+			string enc;
+			unordered_map<uint32_t, uint32_t> seen;
+			dt.root().hash();
+			dt.root().encode(enc, seen);
+			render(walker, file, false);
+		}
+		unlink(file.c_str());
+	}
+
+} // Anonymous namespace
+
+/** libFuzzer entry point.
+ * @param data_i Input data.
+ * @param size_i Size of the input.
+ * @returns Always 0. */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t * data_i, size_t size_i)
+{
+	// Exceptions carry the logged error message, so errors are logged
+	// into a stream without buffer
+	static ostream discard(nullptr);
+	Fs2a::Logger::instance()->stream(&discard);
+	Fs2a::Logger::instance()->maxlevel(Fs2a::Logger::error);
+	setup();
+
+	string input(reinterpret_cast<const char *>(data_i), size_i);
+	if (images) mutate(input);
+	else check(input);
+	return 0;
+}
+
+#ifdef CLTE_FUZZ_MAIN
+/** Run the checks on all files given on the command line.
+ * @returns 0 when all checks pass, the process aborts otherwise. */
+int main(int argc, char *argv[])
+{
+	for (int i = 1; i < argc; i++) {
+		ifstream ifs(argv[i], ios::binary);
+		if (!ifs.good()) {
+			cerr << "Unable to open " << argv[i] << endl;
+			return 1;
+		}
+		string input((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
+		LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t *>(input.data()), input.size());
+	}
+
+	return 0;
+}
+#endif
@@ -0,0 +1,408 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <mutex>
+#include <stdexcept>
+#include "Logger.h"
+#include "Binding.h"
+
+namespace Clte
+{
+
+	namespace
+	{
+
+		// Maps with more pairs get a table to find their keys
+		const size_t linear = 8;
+
+	} // Anonymous namespace
+
+	Binding::Binding(Lua & lua_i)
+	: lua_a(lua_i), data_a(nullptr), generation_a(0), meta_a(LUA_NOREF), strings_a(LUA_NOREF), proxies_a(LUA_NOREF), keys_a(LUA_NOREF), lists_a(LUA_NOREF), avoided_a(0)
+	{
+		lua_State * L = lua_a.state();
+
+		// Proxies are read-only and templates can't get at their metatable
+		lua_newtable(L);
+		lua_pushlightuserdata(L, this);
+		lua_pushcclosure(L, &Binding::index, 1);
+		lua_setfield(L, -2, "__index");
+		lua_pushlightuserdata(L, this);
+		lua_pushcclosure(L, &Binding::length, 1);
+		lua_setfield(L, -2, "__len");
+		lua_pushboolean(L, 0);
+		lua_setfield(L, -2, "__metatable");
+		meta_a = luaL_ref(L, LUA_REGISTRYINDEX);
+
+		// Lua 5.1 and LuaJIT don't know __pairs and __ipairs
+		lua_pushlightuserdata(L, this);
+		lua_getglobal(L, "pairs");
+		lua_pushcclosure(L, &Binding::pairs, 2);
+		lua_setglobal(L, "pairs");
+		lua_pushlightuserdata(L, this);
+		lua_getglobal(L, "ipairs");
+		lua_pushcclosure(L, &Binding::ipairs, 2);
+		lua_setglobal(L, "ipairs");
+	}
+
+	Binding::~Binding()
+	{
+		unbind();
+		lua_a.release(meta_a);
+	}
+
+	void Binding::bind(const Data & data_i)
+	{
+		lua_State * L = lua_a.state();
+
+		unbind();
+		lua_newtable(L);
+		strings_a = luaL_ref(L, LUA_REGISTRYINDEX);
+		lua_newtable(L);
+		proxies_a = luaL_ref(L, LUA_REGISTRYINDEX);
+		lua_newtable(L);
+		keys_a = luaL_ref(L, LUA_REGISTRYINDEX);
+		lua_newtable(L);
+		lists_a = luaL_ref(L, LUA_REGISTRYINDEX);
+		data_a = &data_i;
+	}
+
+	int Binding::index(lua_State * L)
+	{
+		Binding * bnd = static_cast<Binding *>(lua_touserdata(L, lua_upvalueindex(1)));
+		const Proxy * pxy = bnd->proxy(L, 1);
+
+		if (pxy == nullptr || pxy->generation != bnd->generation_a) return luaL_error(L, "data element is no longer available");
+		Data::Node nd = bnd->data_a->node(pxy->index);
+
+		if (nd.type() == Data::map_node) {
+			if (lua_type(L, 2) == LUA_TSTRING) bnd->value(nd, 2);
+			else lua_pushnil(L);
+			return 1;
+		}
+
+		// Only whole numbers within the sequence are elements
+		lua_Number num = lua_type(L, 2) == LUA_TNUMBER ? lua_tonumber(L, 2) : 0;
+		size_t pos = num >= 1 && num <= nd.size() ? static_cast<size_t>(num) : 0;
+		if (pos > 0 && pos == num) bnd->push(nd[pos - 1]);
+		else lua_pushnil(L);
+		return 1;
+	}
+
+	int Binding::ipairs(lua_State * L)
+	{
+		Binding * bnd = static_cast<Binding *>(lua_touserdata(L, lua_upvalueindex(1)));
+		const Proxy * pxy = bnd->proxy(L, 1);
+
+		if (pxy == nullptr) {
+			int nargs = lua_gettop(L);
+			lua_pushvalue(L, lua_upvalueindex(2));
+			lua_insert(L, 1);
+			lua_call(L, nargs, LUA_MULTRET);
+			return lua_gettop(L);
+		}
+		if (pxy->generation != bnd->generation_a) return luaL_error(L, "data element is no longer available");
+
+		// Maps have no integer keys, so there is nothing to iterate
+		Data::Node nd = bnd->data_a->node(pxy->index);
+		lua_pushlightuserdata(L, bnd);
+		lua_pushinteger(L, nd.type() == Data::sequence_node ? 0 : nd.size());
+		lua_pushboolean(L, 1);
+		lua_pushcclosure(L, &Binding::next, 3);
+		lua_pushvalue(L, 1);
+		lua_pushinteger(L, 0);
+		return 3;
+	}
+
+	int Binding::length(lua_State * L)
+	{
+		Binding * bnd = static_cast<Binding *>(lua_touserdata(L, lua_upvalueindex(1)));
+		const Proxy * pxy = bnd->proxy(L, 1);
+
+		if (pxy == nullptr || pxy->generation != bnd->generation_a) return luaL_error(L, "data element is no longer available");
+
+		// Like a table with only string keys, maps have length 0
+		Data::Node nd = bnd->data_a->node(pxy->index);
+		lua_pushinteger(L, nd.type() == Data::sequence_node ? nd.size() : 0);
+		return 1;
+	}
+
+	void Binding::list(const std::vector<uint32_t> & nodes_i)
+	{
+		lua_State * L = lua_a.state();
+		void * id = const_cast<std::vector<uint32_t> *>(&nodes_i);
+
+		if (data_a == nullptr) {
+			lua_newtable(L);
+			return;
+		}
+
+		lua_rawgeti(L, LUA_REGISTRYINDEX, lists_a);
+		lua_pushlightuserdata(L, id);
+		lua_rawget(L, -2);
+		if (lua_isnil(L, -1)) {
+			lua_pop(L, 1);
+			lua_createtable(L, nodes_i.size(), 0);
+			for (size_t i = 0; i < nodes_i.size(); i++) {
+				push(data_a->node(nodes_i[i]));
+				lua_rawseti(L, -2, i + 1);
+			}
+			lua_pushlightuserdata(L, id);
+			lua_pushvalue(L, -2);
+			lua_rawset(L, -4);
+		}
+		lua_remove(L, -2);
+	}
+
+	int Binding::next(lua_State * L)
+	{
+		Binding * bnd = static_cast<Binding *>(lua_touserdata(L, lua_upvalueindex(1)));
+		size_t pos = lua_tointeger(L, lua_upvalueindex(2));
+		bool ordered = lua_toboolean(L, lua_upvalueindex(3));
+		const Proxy * pxy = bnd->proxy(L, 1);
+
+		if (pxy == nullptr || pxy->generation != bnd->generation_a) return luaL_error(L, "data element is no longer available");
+		Data::Node nd = bnd->data_a->node(pxy->index);
+		bool seq = nd.type() == Data::sequence_node;
+
+		// Tables can't hold nil, so pairs() skips null nodes and ipairs()
+		// stops at the first one
+		for (; pos < nd.size(); pos++) {
+			Data::Node key = seq ? Data::Node() : nd.key(pos);
+			Data::Node val = seq ? nd[pos] : nd.value(pos);
+
+			if (val.type() == Data::null_node || (!seq && key.type() == Data::null_node)) {
+				if (ordered) break;
+				continue;
+			}
+
+			lua_pushinteger(L, pos + 1);
+			lua_replace(L, lua_upvalueindex(2));
+			if (seq) lua_pushinteger(L, pos + 1);
+			else bnd->push(key);
+			bnd->push(val);
+			return 2;
+		}
+
+		lua_pushinteger(L, nd.size());
+		lua_replace(L, lua_upvalueindex(2));
+		return 0;
+	}
+
+	bool Binding::node(const int idx_i, Data::Node & node_o) const
+	{
+		const Proxy * pxy = proxy(lua_a.state(), idx_i);
+
+		if (pxy == nullptr || pxy->generation != generation_a) return false;
+		node_o = data_a->node(pxy->index);
+		return true;
+	}
+
+	int Binding::pairs(lua_State * L)
+	{
+		Binding * bnd = static_cast<Binding *>(lua_touserdata(L, lua_upvalueindex(1)));
+		const Proxy * pxy = bnd->proxy(L, 1);
+
+		if (pxy == nullptr) {
+			int nargs = lua_gettop(L);
+			lua_pushvalue(L, lua_upvalueindex(2));
+			lua_insert(L, 1);
+			lua_call(L, nargs, LUA_MULTRET);
+			return lua_gettop(L);
+		}
+		if (pxy->generation != bnd->generation_a) return luaL_error(L, "data element is no longer available");
+
+		lua_pushlightuserdata(L, bnd);
+		lua_pushinteger(L, 0);
+		lua_pushboolean(L, 0);
+		lua_pushcclosure(L, &Binding::next, 3);
+		lua_pushvalue(L, 1);
+		lua_pushnil(L);
+		return 3;
+	}
+
+	bool Binding::protectedPush(const Data::Node & node_i, const std::string & name_i)
+	{
+		lua_State * L = lua_a.state();
+
+		if (data_a == nullptr || node_i.data() != data_a) {
+			lua_pushnil(L);
+			return true;
+		}
+
+		lua_pushcfunction(L, &Binding::pushed);
+		lua_pushlightuserdata(L, this);
+		lua_pushinteger(L, node_i.index());
+		return lua_a.pcall(2, 1, name_i);
+	}
+
+	const Binding::Proxy * Binding::proxy(lua_State * L, const int idx_i) const
+	{
+		if (lua_type(L, idx_i) != LUA_TUSERDATA || !lua_getmetatable(L, idx_i)) return nullptr;
+
+		lua_rawgeti(L, LUA_REGISTRYINDEX, meta_a);
+		bool ours = lua_rawequal(L, -1, -2);
+		lua_pop(L, 2);
+		return ours ? static_cast<const Proxy *>(lua_touserdata(L, idx_i)) : nullptr;
+	}
+
+	void Binding::push(const Data::Node & node_i)
+	{
+		lua_State * L = lua_a.state();
+
+		if (data_a == nullptr || node_i.data() != data_a) {
+			lua_pushnil(L);
+			return;
+		}
+
+		switch (node_i.type()) {
+			case Data::scalar_node:
+				string(node_i.string());
+				break;
+
+			case Data::sequence_node:
+			case Data::map_node:
+				lua_rawgeti(L, LUA_REGISTRYINDEX, proxies_a);
+				lua_rawgeti(L, -1, node_i.index() + 1);
+				if (lua_isnil(L, -1)) {
+					lua_pop(L, 1);
+					Proxy * pxy = static_cast<Proxy *>(lua_newuserdata(L, sizeof(Proxy)));
+					pxy->index = node_i.index();
+					pxy->generation = generation_a;
+					lua_rawgeti(L, LUA_REGISTRYINDEX, meta_a);
+					lua_setmetatable(L, -2);
+					lua_pushvalue(L, -1);
+					lua_rawseti(L, -3, node_i.index() + 1);
+				}
+				lua_remove(L, -2);
+				break;
+
+			default:
+				lua_pushnil(L);
+				break;
+		}
+	}
+
+	int Binding::pushed(lua_State * L)
+	{
+		Binding * bnd = static_cast<Binding *>(lua_touserdata(L, 1));
+		uint32_t idx = lua_tointeger(L, 2);
+
+		bnd->push(bnd->data_a->node(idx));
+		return 1;
+	}
+
+	void Binding::string(const uint32_t idx_i)
+	{
+		lua_State * L = lua_a.state();
+
+		if (data_a == nullptr || idx_i >= data_a->header().stringcount) {
+			lua_pushnil(L);
+			return;
+		}
+
+		lua_rawgeti(L, LUA_REGISTRYINDEX, strings_a);
+		lua_rawgeti(L, -1, idx_i + 1);
+		if (!lua_isnil(L, -1)) {
+			lua_remove(L, -2);
+			avoided_a++;
+			return;
+		}
+
+		// Intern the string on first use
+		lua_pop(L, 1);
+		std::string_view str = data_a->string(idx_i);
+		lua_pushlstring(L, str.data(), str.size());
+		lua_pushvalue(L, -1);
+		lua_rawseti(L, -3, idx_i + 1);
+		lua_remove(L, -2);
+	}
+
+	void Binding::unbind()
+	{
+		lua_a.release(strings_a);
+		lua_a.release(proxies_a);
+		lua_a.release(keys_a);
+		lua_a.release(lists_a);
+		strings_a = LUA_NOREF;
+		proxies_a = LUA_NOREF;
+		keys_a = LUA_NOREF;
+		lists_a = LUA_NOREF;
+		data_a = nullptr;
+		generation_a++;
+	}
+
+	void Binding::value(const Data::Node & map_i, const int key_i)
+	{
+		lua_State * L = lua_a.state();
+		size_t len = 0, size = map_i.size();
+		const char * key = lua_tolstring(L, key_i, &len);
+
+		// Later pairs win, like in a table built from the document
+		if (size <= linear) {
+			for (size_t i = size; i > 0; i--) {
+				Data::Node cand = map_i.key(i - 1);
+				if (cand.type() == Data::scalar_node && cand.scalar() == std::string_view(key, len)) {
+					push(map_i.value(i - 1));
+					return;
+				}
+			}
+			lua_pushnil(L);
+			return;
+		}
+
+		// Larger maps get a table from key to pair index on first use
+		lua_rawgeti(L, LUA_REGISTRYINDEX, keys_a);
+		lua_rawgeti(L, -1, map_i.index() + 1);
+		if (lua_isnil(L, -1)) {
+			lua_pop(L, 1);
+			lua_createtable(L, 0, size);
+			for (size_t i = 0; i < size; i++) {
+				Data::Node cand = map_i.key(i);
+				if (cand.type() != Data::scalar_node) continue;
+				string(cand.string());
+				lua_pushinteger(L, i);
+				lua_rawset(L, -3);
+			}
+			lua_pushvalue(L, -1);
+			lua_rawseti(L, -3, map_i.index() + 1);
+		}
+		lua_pushvalue(L, key_i);
+		lua_rawget(L, -2);
+		bool found = !lua_isnil(L, -1);
+		size_t pos = found ? lua_tointeger(L, -1) : 0;
+		lua_pop(L, 3);
+		if (found) push(map_i.value(pos));
+		else lua_pushnil(L);
+	}
+
+} // Clte namespace
@@ -0,0 +1,176 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Data.h"
+#include "Lua.h"
+
+namespace Clte
+{
+
+	/** Binds a Data document into a Lua state. Sequences and maps are
+	 * pushed as read-only proxy userdata that look up their elements in
+	 * the document on access, so binding costs the same for any document
+	 * size and a mapped image is only paged in where it is used. Indexing,
+	 * the length operator, pairs() and ipairs() work on proxies like on
+	 * tables. Strings are interned into a Lua table anchored in the
+	 * registry the first time they are pushed, indexed by their string
+	 * table index, so the same key or scalar value is never hashed and
+	 * interned again. Pushing the same node again pushes the same proxy,
+	 * which also allows finding the data node a proxy belongs to. */
+	class Binding
+	{
+		protected:
+		/// Userdata of a proxy
+		struct Proxy {
+			uint32_t index;      ///< Index of the node in the node array
+			uint32_t generation; ///< Binding::generation_a when created
+		};
+
+		// Lua state to bind into
+		Lua & lua_a;
+
+		// Data document currently bound, NULL if none
+		const Data * data_a;
+
+		// Changes with every bind() and unbind(), to detect stale proxies
+		uint32_t generation_a;
+
+		// Registry reference to the metatable of proxies
+		int meta_a;
+
+		// Registry reference to the table of interned strings
+		int strings_a;
+
+		// Registry reference to the table of proxies, by node index
+		int proxies_a;
+
+		// Registry reference to the tables mapping keys of large maps to
+		// their pair index, by node index
+		int keys_a;
+
+		// Registry reference to the tables built by list(), by the
+		// address of their node list
+		int lists_a;
+
+		// Number of string pushes served from the interned table
+		uint64_t avoided_a;
+
+		// Lua: __index metamethod of proxies
+		static int index(lua_State * L);
+
+		// Lua: ipairs() replacement, iterates over sequence proxies
+		static int ipairs(lua_State * L);
+
+		// Lua: __len metamethod of proxies
+		static int length(lua_State * L);
+
+		// Lua: iterator function returned by pairs() and ipairs()
+		static int next(lua_State * L);
+
+		// Lua: pairs() replacement, iterates over proxies
+		static int pairs(lua_State * L);
+
+		// Lua: push the node with the index at 2 of the binding at 1
+		static int pushed(lua_State * L);
+
+		// Get the proxy at a stack index, NULL if the value is not a proxy
+		// of this binding. Check its generation before use.
+		const Proxy * proxy(lua_State * L, const int idx_i) const;
+
+		// Push the value of a map pair by key, nil if not found
+		void value(const Data::Node & map_i, const int key_i);
+
+		public:
+		/** Constructor, replaces pairs() and ipairs() in the Lua state by
+		 * versions that also iterate over proxies.
+		 * @param lua_i Lua state to bind data into. */
+		Binding(Lua & lua_i);
+
+		// Default destructor, releases the interned strings
+		~Binding();
+
+		/** Get the number of string hashes avoided so far, i.e. the number
+		 * of strings pushed from the interned table.
+		 * @returns Number of avoided hashing calls. */
+		inline uint64_t avoided() const { return avoided_a; }
+
+		/** Bind a document. Any previously bound document is released.
+		 * Nothing is converted or interned up front.
+		 * @param data_i Document to bind, must stay valid until the next
+		 * call to bind() or unbind(), or destruction. */
+		void bind(const Data & data_i);
+
+		/** Push a list of nodes of the bound document as a Lua sequence.
+		 * The table is built on first use and pushed again for the same
+		 * list until the next bind() or unbind(), so the list may not
+		 * change meanwhile and Lua code should not modify the table. This
+		 * may raise Lua errors, like push().
+		 * @param nodes_i Node indices of the elements, in order. */
+		void list(const std::vector<uint32_t> & nodes_i);
+
+		/** Find the data node a proxy belongs to.
+		 * @param idx_i Stack index of the proxy.
+		 * @param node_o Node to store the result in.
+		 * @returns True if found, false if the value at @p idx_i is not
+		 * a proxy of the bound document. */
+		bool node(const int idx_i, Data::Node & node_o) const;
+
+		/** Push a node of the bound document onto the Lua stack. Scalars are
+		 * pushed as strings, sequences and maps as proxies and null nodes,
+		 * as well as nodes of other documents, as nil. This may raise Lua
+		 * errors, so only call it from a C function called by Lua.
+		 * @param node_i Node to push. */
+		void push(const Data::Node & node_i);
+
+		/** Push a node like push(), but in a protected call.
+		 * @param node_i Node to push.
+		 * @param name_i Name for error messages.
+		 * @returns True if successful, false if not. */
+		bool protectedPush(const Data::Node & node_i, const std::string & name_i);
+
+		/** Push an interned string onto the Lua stack. This may raise Lua
+		 * errors, like push().
+		 * @param idx_i Index in the string table of the bound document. */
+		void string(const uint32_t idx_i);
+
+		/** Release the bound document, its interned strings and proxies.
+		 * Call this before the document is destroyed. Proxies still
+		 * referenced from Lua raise an error when used afterwards. */
+		void unbind();
+	};
+
+} // Clte namespace
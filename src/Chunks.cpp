@@ -0,0 +1,114 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include "Chunks.h"
+#include "Logger.h"
+
+namespace Clte
+{
+
+	Chunks::Chunks(Renderer & rnd_i, const size_t bufsize_i, const size_t depth_i)
+	: QueueBuf(bufsize_i, depth_i), rnd_a(rnd_i), os_a(this), done_a(false), cancelled_a(false)
+	{
+		rnd_a.out(&os_a);
+		thread_a = std::thread(&Chunks::producer, this);
+	}
+
+	Chunks::~Chunks()
+	{
+		{
+			GRD(mux_a);
+			cancelled_a = true;
+		}
+		cv_a.notify_all();
+		thread_a.join();
+	}
+
+	void Chunks::handoff()
+	{
+		if (cur_a.empty()) return;
+
+		std::unique_lock<std::mutex> lck(mux_a);
+		cv_a.wait(lck, [this]() { return cancelled_a || queue_a.size() < depth_a; });
+
+		// Nobody pulls anymore, let the renderer finish quickly
+		if (cancelled_a) {
+			cur_a.clear();
+			return;
+		}
+
+		queue_a.push_back(std::move(cur_a));
+		renew();
+		lck.unlock();
+		cv_a.notify_all();
+	}
+
+	bool Chunks::next(std::vector<char> & chunk_o)
+	{
+		std::unique_lock<std::mutex> lck(mux_a);
+
+		cv_a.wait(lck, [this]() { return done_a || !queue_a.empty(); });
+		if (queue_a.empty()) {
+			if (!error_a) return false;
+			std::exception_ptr err = error_a;
+			error_a = nullptr;
+			std::rethrow_exception(err);
+		}
+
+		if (chunk_o.capacity() >= bufsize_a) recycle(std::move(chunk_o));
+		chunk_o = std::move(queue_a.front());
+		queue_a.pop_front();
+		lck.unlock();
+		cv_a.notify_all();
+		return true;
+	}
+
+	void Chunks::producer()
+	{
+		std::exception_ptr err;
+
+		try {
+			rnd_a.render();
+		} catch (...) {
+			err = std::current_exception();
+		}
+		handoff();
+
+		{
+			GRD(mux_a);
+			error_a = err;
+			done_a = true;
+		}
+		cv_a.notify_all();
+	}
+
+} // Clte namespace
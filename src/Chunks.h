@@ -0,0 +1,111 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#pragma once
+
+#include <deque>
+#include <exception>
+#include <ostream>
+#include <thread>
+#include <vector>
+#include "QueueBuf.h"
+#include "Renderer.h"
+
+namespace Clte
+{
+
+	/** Pull-based rendering, for embedders that stream output into a
+	 * compiler or socket instead of collecting it in an std::ostream. The
+	 * renderer runs in a producer thread and its output is cut into chunks
+	 * of bounded size, which are passed to the caller of next() through a
+	 * bounded queue. The producer waits while the queue is full, so memory
+	 * use is constant no matter how large the output is, and the first
+	 * chunk is available as soon as it is filled. */
+	class Chunks : public QueueBuf
+	{
+		protected:
+		// Renderer producing the output
+		Renderer & rnd_a;
+
+		// Output stream given to the renderer
+		std::ostream os_a;
+
+		// Chunks waiting to be pulled, protected by mux_a like error_a,
+		// done_a and cancelled_a
+		std::deque<std::vector<char> > queue_a;
+
+		// Producer thread
+		std::thread thread_a;
+
+		// Exception thrown by the renderer, if any
+		std::exception_ptr error_a;
+
+		// Set when the renderer is done
+		bool done_a;
+
+		// Set when no more chunks will be pulled, output is discarded
+		bool cancelled_a;
+
+		// Queue the current chunk and start a fresh one
+		void handoff() override;
+
+		// Producer thread main function
+		void producer();
+
+		public:
+		/** Constructor, sets the output of the renderer and starts
+		 * rendering in the producer thread. Set the input and data of the
+		 * renderer before.
+		 * @param rnd_i Renderer to pull output from, must outlive this.
+		 * @param bufsize_i Maximum size of a chunk, default 64 KiB.
+		 * @param depth_i Maximum number of chunks waiting, default 4.
+		 * @throws std::invalid_argument when @p bufsize_i or @p depth_i
+		 * is 0.
+		 * @throws std::logic_error when the output of @p rnd_i is already
+		 * set. */
+		Chunks(Renderer & rnd_i, const size_t bufsize_i = 64 * 1024, const size_t depth_i = 4);
+
+		/** Destructor, discards the remaining output and waits for the
+		 * renderer to finish. */
+		~Chunks();
+
+		/** Get the next chunk of output, waiting until it is available.
+		 * @param chunk_o Replaced by the next chunk. Its previous buffer is
+		 * reused for later chunks.
+		 * @returns True if a chunk was returned, false at the end of the
+		 * output.
+		 * @throws std::runtime_error (or whatever the renderer threw) at
+		 * the end of the output if rendering failed. */
+		bool next(std::vector<char> & chunk_o);
+	};
+
+} // Clte namespace
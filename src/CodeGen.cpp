@@ -0,0 +1,213 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include "CodeGen.h"
+#include "Logger.h"
+
+namespace Clte
+{
+
+	namespace
+	{
+
+		// Names of the size classes in generated code
+		const char * const classes[] = { "Emit::inline16", "Emit::inline32", "Emit::inline64", "Emit::copy", "Emit::reference" };
+
+		// Strip leading and trailing white space
+		std::string_view trim(const std::string_view & str_i)
+		{
+			size_t first = str_i.find_first_not_of(" \t\r\n");
+			if (first == std::string_view::npos) return std::string_view();
+			return str_i.substr(first, str_i.find_last_not_of(" \t\r\n") - first + 1);
+		}
+
+	} // Anonymous namespace
+
+	CodeGen::CodeGen()
+	: count_a(0)
+	{ }
+
+	size_t CodeGen::block(const Template::Node * first_i)
+	{
+		std::ostringstream body;
+		size_t idx = blocks_a.size();
+
+		// Nested blocks are numbered after this one
+		blocks_a.emplace_back();
+		statements(first_i, body, "\t\t");
+
+		std::ostringstream fun;
+		fun << "\tbool block" << idx << "(Native & rnd)\n\t{\n";
+		fun << body.str();
+		if (first_i == nullptr) fun << "\t\t(void)rnd;\n";
+		fun << "\t\treturn true;\n\t}\n";
+		blocks_a[idx] = fun.str();
+		return idx;
+	}
+
+	size_t CodeGen::chunk(const Template::Node * node_i)
+	{
+		// Expressions return their value, @! blocks are plain code
+		std::string code(node_i->text);
+		if (node_i->type != Template::exec_node) code = "return " + code;
+
+		chunks_a << "\t\t{ ";
+		quote(chunks_a, code, "\t\t  ");
+		chunks_a << ", " << node_i->line << " },\n";
+		return count_a++;
+	}
+
+	bool CodeGen::generate(const Template & tpl_i, std::ostream & out_i)
+	{
+		block(tpl_i.root());
+
+		out_i << "// Generated by clite --emit-cpp from " << tpl_i.name() << ", do not edit\n\n";
+		out_i << "#include \"Native.h\"\n\n";
+		out_i << "namespace\n{\n\n";
+		out_i << "\tnamespace Emit = Clte::Emit;\n";
+		out_i << "\tusing Clte::Native;\n\n";
+		out_i << literals_a.str();
+		if (!texts_a.empty()) out_i << "\n";
+		out_i << "\tconst Native::Chunk chunks[] = {\n" << chunks_a.str() << "\t\t{ nullptr, 0 }\n\t};\n\n";
+		for (size_t i = 1; i < blocks_a.size(); i++) out_i << "\tbool block" << i << "(Native & rnd);\n";
+		for (const std::string & blk : blocks_a) out_i << "\n" << blk;
+		out_i << "\n} // Anonymous namespace\n\n";
+		out_i << "int main(int argc, char * argv[])\n{\n";
+		out_i << "\tNative rnd(";
+		quote(out_i, tpl_i.name(), "\t\t");
+		out_i << ", chunks, &block0);\n";
+		out_i << "\treturn rnd.main(argc, argv);\n}\n";
+
+		LCER(out_i.good(), false, "Unable to write C++ source for template %s", tpl_i.name().c_str());
+		LD("Translated template %s into %zu blocks, %zu literals and %zu chunks", tpl_i.name().c_str(), blocks_a.size(), texts_a.size(), count_a);
+		return true;
+	}
+
+	size_t CodeGen::literal(const std::string_view & text_i)
+	{
+		auto it = texts_a.find(text_i);
+		if (it != texts_a.end()) return it->second;
+
+		size_t idx = texts_a.size();
+		literals_a << "\tconst char lit" << idx << "[] = ";
+		quote(literals_a, text_i, "\t\t");
+		literals_a << ";\n";
+		texts_a.emplace(text_i, idx);
+		return idx;
+	}
+
+	void CodeGen::quote(std::ostream & out_i, const std::string_view & str_i, const std::string & indent_i)
+	{
+		static const char digits[] = "01234567";
+		size_t col = 0;
+
+		out_i << '"';
+		for (size_t i = 0; i < str_i.size(); i++) {
+			unsigned char ch = str_i[i];
+
+			switch (ch) {
+				case '\\': out_i << "\\\\"; break;
+				case '"': out_i << "\\\""; break;
+				case '\n': out_i << "\\n"; break;
+				case '\r': out_i << "\\r"; break;
+				case '\t': out_i << "\\t"; break;
+				case '?': out_i << "\\?"; break; // No trigraphs
+				default:
+					// Octal escapes always have three digits, so a following
+					// digit can't become part of them
+					if (ch < 0x20 || ch >= 0x7f) {
+						out_i << '\\' << digits[ch >> 6] << digits[(ch >> 3) & 7] << digits[ch & 7];
+					} else {
+						out_i << ch;
+					}
+					break;
+			}
+
+			// Keep lines of generated code short, breaking after newlines
+			if (++col >= 64 || (ch == '\n' && i + 1 < str_i.size())) {
+				if (i + 1 < str_i.size()) out_i << "\"\n" << indent_i << '"';
+				col = 0;
+			}
+		}
+		out_i << '"';
+	}
+
+	void CodeGen::statements(const Template::Node * first_i, std::ostream & out_i, const std::string & indent_i)
+	{
+		for (const Template::Node * nd = first_i; nd != nullptr; nd = nd->next) {
+			size_t idx = 0;
+
+			switch (nd->type) {
+				case Template::literal_node:
+					idx = literal(nd->text);
+					out_i << indent_i << "rnd.emitter().emit<" << classes[nd->emit] << ">(std::string_view(lit";
+					out_i << idx << ", sizeof(lit" << idx << ") - 1));\n";
+					break;
+
+				case Template::output_node:
+					out_i << indent_i << "if (!rnd.output(" << chunk(nd) << ")) return false;\n";
+					break;
+
+				case Template::exec_node:
+					out_i << indent_i << "if (!rnd.exec(" << chunk(nd) << ")) return false;\n";
+					break;
+
+				case Template::if_node:
+					out_i << indent_i << "{\n";
+					out_i << indent_i << "\tbool cond = false;\n";
+					out_i << indent_i << "\tif (!rnd.test(" << chunk(nd) << ", cond)) return false;\n";
+					out_i << indent_i << "\tif (cond) {\n";
+					statements(nd->body, out_i, indent_i + "\t\t");
+					if (nd->alt != nullptr) {
+						out_i << indent_i << "\t} else {\n";
+						statements(nd->alt, out_i, indent_i + "\t\t");
+					}
+					out_i << indent_i << "\t}\n";
+					out_i << indent_i << "}\n";
+					break;
+
+				case Template::iterate_node:
+					idx = chunk(nd);
+					out_i << indent_i << "if (!rnd.iterate(" << idx << ", " << (trim(nd->text) == "data" ? "true" : "false");
+					out_i << ", &block" << block(nd->body) << ")) return false;\n";
+					break;
+
+				case Template::key_node:
+				case Template::value_node:
+					out_i << indent_i << "if (!rnd.write(" << nd->depth << ", " << (nd->type == Template::value_node ? "true" : "false");
+					out_i << ", " << nd->line << ")) return false;\n";
+					break;
+			}
+		}
+	}
+
+} // Clte namespace
@@ -0,0 +1,108 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#pragma once
+
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "Template.h"
+
+namespace Clte
+{
+
+	/** Translates a parsed template into a C++ translation unit, for
+	 * clite --emit-cpp. Literal text becomes constant arrays emitted with
+	 * their size class fixed at compile time, @? and @$ blocks become
+	 * native control flow and only the Lua code is kept as strings, to be
+	 * compiled by Native on first use. The result is a complete program to
+	 * link against libclte. */
+	class CodeGen
+	{
+		protected:
+		// Generated literal arrays
+		std::ostringstream literals_a;
+
+		// Generated entries of the chunk table
+		std::ostringstream chunks_a;
+
+		// Generated block functions, by block number
+		std::vector<std::string> blocks_a;
+
+		// Literal numbers by text, to share identical literals
+		std::unordered_map<std::string_view, size_t> texts_a;
+
+		// Number of chunks generated
+		size_t count_a;
+
+		/** Generate a function for a list of nodes.
+		 * @param first_i First node of the list.
+		 * @returns Block number. */
+		size_t block(const Template::Node * first_i);
+
+		/** Generate a chunk table entry for the Lua code of a node.
+		 * @param node_i Template node.
+		 * @returns Chunk index. */
+		size_t chunk(const Template::Node * node_i);
+
+		/** Generate a literal array, unless the same text has one already.
+		 * @param text_i Literal text.
+		 * @returns Literal number. */
+		size_t literal(const std::string_view & text_i);
+
+		/** Write a string as C++ string literals, split over lines.
+		 * @param out_i Stream to write to.
+		 * @param str_i String to write.
+		 * @param indent_i Indentation of continuation lines. */
+		static void quote(std::ostream & out_i, const std::string_view & str_i, const std::string & indent_i);
+
+		/** Generate the statements for a list of nodes.
+		 * @param first_i First node of the list.
+		 * @param out_i Stream to write the statements to.
+		 * @param indent_i Indentation of the statements. */
+		void statements(const Template::Node * first_i, std::ostream & out_i, const std::string & indent_i);
+
+		public:
+		// Default constructor
+		CodeGen();
+
+		/** Translate a template.
+		 * @param tpl_i Parsed template.
+		 * @param out_i Stream to write the translation unit to.
+		 * @returns True if successful, false if writing failed. */
+		bool generate(const Template & tpl_i, std::ostream & out_i);
+	};
+
+} // Clte namespace
@@ -0,0 +1,431 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <yaml-cpp/yaml.h>
+#include "Logger.h"
+#include "Data.h"
+#include "DataBuilder.h"
+#include "Memory.h"
+#include "Stats.h"
+
+namespace Clte
+{
+
+	constexpr char Data::magic[8];
+
+	Data::Node::Node()
+	: data_a(nullptr), index_a(0)
+	{ }
+
+	Data::Node::Node(const Data * data_i, const uint32_t index_i)
+	: data_a(data_i), index_a(index_i)
+	{ }
+
+	const Data::Entry & Data::Node::entry() const
+	{
+		const Header & hdr = data_a->header();
+		return reinterpret_cast<const Entry *>(data_a->image_a + hdr.nodes)[index_a];
+	}
+
+	Data::type_t Data::Node::type() const
+	{
+		if (data_a == nullptr) return null_node;
+		return static_cast<type_t>(entry().type);
+	}
+
+	size_t Data::Node::size() const
+	{
+		type_t tp = type();
+		if (tp != sequence_node && tp != map_node) return 0;
+		return entry().size;
+	}
+
+	uint32_t Data::Node::string() const
+	{
+		LCET(type() == scalar_node, std::logic_error, "Node %u is not a scalar", index_a);
+		return entry().value;
+	}
+
+	std::string_view Data::Node::scalar() const
+	{
+		if (type() != scalar_node) return std::string_view();
+		return data_a->string(entry().value);
+	}
+
+	Data::Node Data::Node::operator[](const size_t idx_i) const
+	{
+		LCET(type() == sequence_node, std::out_of_range, "Node %u is not a sequence", index_a);
+		const Entry & ent = entry();
+		LCET(idx_i < ent.size, std::out_of_range, "Index %zu out of range for sequence of %u elements", idx_i, ent.size);
+		const Header & hdr = data_a->header();
+		const uint32_t * kids = reinterpret_cast<const uint32_t *>(data_a->image_a + hdr.children);
+		return Node(data_a, kids[ent.value + idx_i]);
+	}
+
+	Data::Node Data::Node::key(const size_t idx_i) const
+	{
+		LCET(type() == map_node, std::out_of_range, "Node %u is not a map", index_a);
+		const Entry & ent = entry();
+		LCET(idx_i < ent.size, std::out_of_range, "Index %zu out of range for map of %u pairs", idx_i, ent.size);
+		const Header & hdr = data_a->header();
+		const uint32_t * kids = reinterpret_cast<const uint32_t *>(data_a->image_a + hdr.children);
+		return Node(data_a, kids[ent.value + 2 * idx_i]);
+	}
+
+	Data::Node Data::Node::value(const size_t idx_i) const
+	{
+		LCET(type() == map_node, std::out_of_range, "Node %u is not a map", index_a);
+		const Entry & ent = entry();
+		LCET(idx_i < ent.size, std::out_of_range, "Index %zu out of range for map of %u pairs", idx_i, ent.size);
+		const Header & hdr = data_a->header();
+		const uint32_t * kids = reinterpret_cast<const uint32_t *>(data_a->image_a + hdr.children);
+		return Node(data_a, kids[ent.value + 2 * idx_i + 1]);
+	}
+
+	Data::Node Data::Node::find(const std::string_view & key_i) const
+	{
+		if (type() != map_node) return Node();
+
+		for (size_t i = 0; i < size(); i++) {
+			if (key(i).scalar() == key_i) return value(i);
+		}
+
+		return Node();
+	}
+
+	void Data::Node::encode(std::string & out_o, std::unordered_map<uint32_t, uint32_t> & seen_io) const
+	{
+		type_t tp = type();
+		uint64_t len = tp == scalar_node ? scalar().size() : size();
+
+		// Refer back to a shared node encoded before
+		if (tp != null_node) {
+			auto res = seen_io.emplace(index_a, seen_io.size());
+			if (!res.second) {
+				out_o.push_back('r');
+				out_o.append(reinterpret_cast<const char *>(&res.first->second), sizeof(uint32_t));
+				return;
+			}
+		}
+
+		// Lengths are included so differently split content differs
+		out_o.push_back(static_cast<char>(tp));
+		out_o.append(reinterpret_cast<const char *>(&len), sizeof(len));
+		switch (tp) {
+			case scalar_node:
+				out_o.append(scalar());
+				break;
+
+			case sequence_node:
+				for (size_t i = 0; i < len; i++) (*this)[i].encode(out_o, seen_io);
+				break;
+
+			case map_node:
+				for (size_t i = 0; i < len; i++) {
+					key(i).encode(out_o, seen_io);
+					value(i).encode(out_o, seen_io);
+				}
+				break;
+
+			default:
+				break;
+		}
+	}
+
+	uint64_t Data::Node::hash(const uint64_t seed_i) const
+	{
+		const uint64_t prime = 0x100000001b3ULL;
+		type_t tp = type();
+
+		if (tp == null_node) return (seed_i ^ tp) * prime;
+
+		std::vector<uint64_t> & memo = data_a->hashes_a;
+		if (memo.empty()) {
+			memo.assign(data_a->header().nodecount, 0);
+			Memory::instance()->add(Memory::data_memory, memo.size() * sizeof(uint64_t));
+		}
+		if (memo[index_a] != 0) return (seed_i ^ memo[index_a]) * prime;
+
+		// Sizes are included so differently split content differs
+		std::string_view str = scalar();
+		uint64_t hash = (0xcbf29ce484222325ULL ^ tp) * prime;
+		hash = (hash ^ (tp == scalar_node ? str.size() : size())) * prime;
+		switch (tp) {
+			case scalar_node:
+				for (char ch : str) hash = (hash ^ static_cast<unsigned char>(ch)) * prime;
+				break;
+
+			case sequence_node:
+				for (size_t i = 0; i < size(); i++) hash = (*this)[i].hash(hash);
+				break;
+
+			case map_node:
+				for (size_t i = 0; i < size(); i++) hash = value(i).hash(key(i).hash(hash));
+				break;
+
+			default:
+				break;
+		}
+
+		// Zero marks hashes not calculated yet
+		memo[index_a] = hash == 0 ? 1 : hash;
+		return (seed_i ^ memo[index_a]) * prime;
+	}
+
+	Data::Data()
+	: image_a(nullptr), mapsize_a(0)
+	{ }
+
+	Data::~Data()
+	{
+		clear();
+	}
+
+	uint64_t Data::checksum(const char * start_i, const size_t size_i)
+	{
+		const uint64_t * words = reinterpret_cast<const uint64_t *>(start_i);
+		uint64_t hash = 0xcbf29ce484222325ULL;
+
+		for (size_t i = 0; i < size_i / sizeof(uint64_t); i++) {
+			hash ^= words[i];
+			hash *= 0x100000001b3ULL;
+		}
+
+		return hash;
+	}
+
+	void Data::clear()
+	{
+		if (image_a != nullptr) {
+			Memory::instance()->sub(Memory::data_memory, mapsize_a > 0 ? mapsize_a : buf_a.size() * sizeof(uint64_t));
+		}
+		if (mapsize_a > 0) {
+			munmap(const_cast<char *>(image_a), mapsize_a);
+			mapsize_a = 0;
+		}
+		buf_a.clear();
+		buf_a.shrink_to_fit();
+		Memory::instance()->sub(Memory::data_memory, hashes_a.size() * sizeof(uint64_t));
+		hashes_a.clear();
+		hashes_a.shrink_to_fit();
+		image_a = nullptr;
+	}
+
+	const Data::Header & Data::header() const
+	{
+		LCET(image_a != nullptr, std::logic_error, "No data document loaded");
+		return *reinterpret_cast<const Header *>(image_a);
+	}
+
+	bool Data::load(const std::string & filename_i)
+	{
+		char buf[sizeof(magic)];
+		std::ifstream ifs(filename_i, std::ios::binary);
+
+		LCER(ifs.good(), false, "Unable to open data file %s", filename_i.c_str());
+		ifs.read(buf, sizeof(buf));
+		if (ifs.gcount() == sizeof(buf) && memcmp(buf, magic, sizeof(magic)) == 0) {
+			return map(filename_i);
+		}
+
+		return yaml(filename_i);
+	}
+
+	bool Data::map(const std::string & filename_i)
+	{
+		struct stat st;
+		void * ptr = nullptr;
+
+		clear();
+		int fd = open(filename_i.c_str(), O_RDONLY);
+		LCER(fd >= 0, false, "Unable to open data file %s: %s", filename_i.c_str(), strerror(errno));
+		if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(Header)) {
+			ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		}
+		close(fd);
+		LCER(ptr != nullptr && ptr != MAP_FAILED, false, "Unable to map data file %s", filename_i.c_str());
+
+		image_a = static_cast<const char *>(ptr);
+		mapsize_a = st.st_size;
+		Memory::instance()->add(Memory::data_memory, mapsize_a);
+		Stats::add(Stats::bytes_in, mapsize_a);
+		if (!validate(mapsize_a, filename_i)) {
+			clear();
+			return false;
+		}
+
+		LD("Mapped %zu bytes of precompiled data from %s", mapsize_a, filename_i.c_str());
+		return true;
+	}
+
+	Data::Node Data::node(const uint32_t idx_i) const
+	{
+		const Header & hdr = header();
+		LCET(idx_i < hdr.nodecount, std::out_of_range, "Node index %u out of range", idx_i);
+		return Node(this, idx_i);
+	}
+
+	Data::Node Data::root() const
+	{
+		if (image_a == nullptr) return Node();
+		return Node(this, header().root);
+	}
+
+	bool Data::save(const std::string & filename_i) const
+	{
+		const Header & hdr = header();
+		std::ofstream ofs(filename_i, std::ios::binary | std::ios::trunc);
+
+		LCER(ofs.good(), false, "Unable to open %s for writing", filename_i.c_str());
+		ofs.write(image_a, hdr.size);
+		ofs.close();
+		LCER(ofs.good(), false, "Error writing precompiled data to %s", filename_i.c_str());
+		return true;
+	}
+
+	std::string_view Data::string(const uint32_t idx_i) const
+	{
+		const Header & hdr = header();
+		LCET(idx_i < hdr.stringcount, std::out_of_range, "String index %u out of range", idx_i);
+		const String & str = reinterpret_cast<const String *>(image_a + hdr.strings)[idx_i];
+		return std::string_view(image_a + hdr.bytes + str.offset, str.length);
+	}
+
+	bool Data::validate(const size_t size_i, const std::string & name_i) const
+	{
+		const Header & hdr = header();
+
+		// Check that count_i items of size_i fit between off_i and end_i,
+		// written so that no sum or product can overflow
+		auto fits = [](const uint64_t off_i, const uint64_t count_i, const size_t size_i, const uint64_t end_i) {
+			return off_i <= end_i && count_i <= (end_i - off_i) / size_i;
+		};
+
+		LCER(memcmp(hdr.magic, magic, sizeof(magic)) == 0, false, "%s is not a precompiled data file", name_i.c_str());
+		LCER(hdr.version == version, false, "%s has layout version %u, expected %u", name_i.c_str(), hdr.version, version);
+		LCER(hdr.order == order, false, "%s was compiled on a machine with different byte order", name_i.c_str());
+		LCER(hdr.size == size_i && size_i % sizeof(uint64_t) == 0, false, "%s has invalid size", name_i.c_str());
+		LCER(hdr.nodes >= sizeof(Header) &&
+			hdr.nodes % alignof(Entry) == 0 && fits(hdr.nodes, hdr.nodecount, sizeof(Entry), hdr.children) &&
+			hdr.children % alignof(uint32_t) == 0 && fits(hdr.children, hdr.childcount, sizeof(uint32_t), hdr.strings) &&
+			hdr.strings % alignof(String) == 0 && fits(hdr.strings, hdr.stringcount, sizeof(String), hdr.bytes) &&
+			hdr.bytes <= hdr.size && hdr.root < hdr.nodecount,
+			false, "%s has an invalid section layout", name_i.c_str());
+		LCER(checksum(image_a + sizeof(Header), size_i - sizeof(Header)) == hdr.checksum,
+			false, "%s has an invalid checksum", name_i.c_str());
+
+		// Every string lies within the string bytes and is NUL terminated
+		const String * strs = reinterpret_cast<const String *>(image_a + hdr.strings);
+		const uint64_t avail = hdr.size - hdr.bytes;
+		for (uint32_t i = 0; i < hdr.stringcount; i++) {
+			const String & str = strs[i];
+			LCER(str.offset < avail && str.length < avail - str.offset &&
+				image_a[hdr.bytes + str.offset + str.length] == '\0',
+				false, "%s has an invalid string %u", name_i.c_str(), i);
+		}
+
+		// Children always precede their parent in the node array, which
+		// also rules out cycles
+		const Entry * ents = reinterpret_cast<const Entry *>(image_a + hdr.nodes);
+		const uint32_t * kids = reinterpret_cast<const uint32_t *>(image_a + hdr.children);
+		for (uint32_t i = 0; i < hdr.nodecount; i++) {
+			const Entry & ent = ents[i];
+			uint64_t count = ent.type == map_node ? 2 * static_cast<uint64_t>(ent.size) : ent.size;
+
+			LCER(ent.type <= map_node, false, "%s has node %u of unknown type %u", name_i.c_str(), i, ent.type);
+			if (ent.type == scalar_node) {
+				LCER(ent.value < hdr.stringcount, false, "%s has node %u with an invalid string", name_i.c_str(), i);
+			} else if (ent.type != null_node) {
+				LCER(fits(ent.value, count, 1, hdr.childcount), false,
+					"%s has node %u with children out of range", name_i.c_str(), i);
+				for (uint64_t j = 0; j < count; j++) {
+					LCER(kids[ent.value + j] < i, false, "%s has node %u with an invalid child", name_i.c_str(), i);
+				}
+			}
+		}
+		return true;
+	}
+
+	size_t Data::stream(const std::string & filename_i, const std::function<void(Data &)> & element_i)
+	{
+		std::ifstream ifs(filename_i);
+		DataBuilder bld(element_i);
+
+		LCET(ifs.good(), std::runtime_error, "Unable to open data file %s", filename_i.c_str());
+		try {
+			YAML::Parser prs(ifs);
+			prs.HandleNextDocument(bld);
+		} catch (const YAML::Exception & e) {
+			LCET(false, std::runtime_error, "Unable to stream YAML data from %s: %s", filename_i.c_str(), e.what());
+		}
+
+		struct stat st;
+		if (stat(filename_i.c_str(), &st) == 0) Stats::add(Stats::bytes_in, st.st_size);
+		LD("Streamed %zu elements from %s", bld.elements(), filename_i.c_str());
+		return bld.elements();
+	}
+
+	bool Data::yaml(std::istream & in_i, const std::string & name_i)
+	{
+		DataBuilder bld;
+
+		try {
+			YAML::Parser prs(in_i);
+			LCER(prs.HandleNextDocument(bld), false, "No YAML document found in %s", name_i.c_str());
+			bld.finish(*this);
+		} catch (const YAML::Exception & e) {
+			LE("Unable to read YAML data from %s: %s", name_i.c_str(), e.what());
+			return false;
+		}
+
+		LD("Read YAML data from %s", name_i.c_str());
+		return true;
+	}
+
+	bool Data::yaml(const std::string & filename_i)
+	{
+		std::ifstream ifs(filename_i);
+		struct stat st;
+
+		LCER(ifs.good(), false, "Unable to open data file %s", filename_i.c_str());
+		if (stat(filename_i.c_str(), &st) == 0) Stats::add(Stats::bytes_in, st.st_size);
+		return yaml(ifs, filename_i);
+	}
+
+} // Clte namespace
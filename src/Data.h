@@ -0,0 +1,305 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace Clte
+{
+
+	/** Data document used to fill a template. The document is kept in a
+	 * flat, position-independent binary image consisting of a header, a
+	 * node array, a child index array and a string table. All references
+	 * inside the image are offsets or indices, so a precompiled image
+	 * (.clted file) can be mapped into memory and used as-is without any
+	 * parsing. */
+	class Data
+	{
+		// Builder hands its images over directly
+		friend class DataBuilder;
+
+		public:
+		/// Node types
+		enum type_t : uint32_t {
+			null_node = 0,
+			scalar_node = 1,
+			sequence_node = 2,
+			map_node = 3
+		};
+
+		/// Magic bytes at the start of a precompiled data file
+		static constexpr char magic[8] = { 'C', 'L', 'T', 'E', 'D', '\r', '\n', '\x1a' };
+
+		/// Current version of the binary layout
+		static constexpr uint32_t version = 1;
+
+		/// Byte order marker, to detect images from other architectures
+		static constexpr uint32_t order = 0x01020304;
+
+		/// Header of a binary image, all offsets are from the image start
+		struct Header {
+			char     magic[8];    ///< Data::magic
+			uint32_t version;     ///< Data::version
+			uint32_t order;       ///< Data::order
+			uint64_t checksum;    ///< FNV-1a of everything after the header
+			uint64_t size;        ///< Total image size, including header
+			uint32_t root;        ///< Index of the root node
+			uint32_t nodecount;   ///< Number of entries in the node array
+			uint32_t childcount;  ///< Number of entries in the child array
+			uint32_t stringcount; ///< Number of entries in the string table
+			uint64_t nodes;       ///< Offset of the node array
+			uint64_t children;    ///< Offset of the child index array
+			uint64_t strings;     ///< Offset of the string table
+			uint64_t bytes;       ///< Offset of the string bytes
+		};
+
+		/// Single node in the node array
+		struct Entry {
+			uint32_t type;  ///< One of type_t
+			uint32_t size;  ///< Number of elements or key/value pairs
+			uint32_t value; ///< String index for scalars, first child index otherwise
+		};
+
+		/// Single string in the string table, bytes are NUL terminated
+		struct String {
+			uint64_t offset; ///< Offset relative to Header::bytes
+			uint64_t length; ///< Length excluding the terminating NUL
+		};
+
+		/** Lightweight read-only view on a node inside a Data image. A
+		 * default constructed or not found node has type null_node. */
+		class Node
+		{
+			friend class Data;
+
+			protected:
+			// Data image this node is part of
+			const Data * data_a;
+
+			// Index in the node array
+			uint32_t index_a;
+
+			// Construct a view on a node
+			Node(const Data * data_i, const uint32_t index_i);
+
+			// Return the entry of this node
+			const Entry & entry() const;
+
+			public:
+			// Default constructor, results in a null node
+			Node();
+
+			/** Get the document this node belongs to.
+			 * @returns Pointer to the document, NULL for a default node. */
+			inline const Data * data() const { return data_a; }
+
+			/** Get the index of this node in the node array.
+			 * @returns Node index. */
+			inline uint32_t index() const { return index_a; }
+
+			/** Get the type of this node.
+			 * @returns Node type, null if the node is invalid. */
+			type_t type() const;
+
+			/** Get the number of elements in a sequence or key/value pairs in
+			 * a map.
+			 * @returns Number of elements, 0 for scalars and null nodes. */
+			size_t size() const;
+
+			/** Get the string index of a scalar node.
+			 * @returns Index in the string table.
+			 * @throws std::logic_error when this is not a scalar. */
+			uint32_t string() const;
+
+			/** Get the value of a scalar node.
+			 * @returns View on the scalar value, empty for non-scalars. */
+			std::string_view scalar() const;
+
+			/** Get an element of a sequence.
+			 * @param idx_i Zero-based element index.
+			 * @returns Element node.
+			 * @throws std::out_of_range when @p idx_i is out of range or
+			 * this is not a sequence. */
+			Node operator[](const size_t idx_i) const;
+
+			/** Get the key of a map pair.
+			 * @param idx_i Zero-based pair index in document order.
+			 * @returns Key node.
+			 * @throws std::out_of_range when @p idx_i is out of range or
+			 * this is not a map. */
+			Node key(const size_t idx_i) const;
+
+			/** Get the value of a map pair.
+			 * @param idx_i Zero-based pair index in document order.
+			 * @returns Value node.
+			 * @throws std::out_of_range when @p idx_i is out of range or
+			 * this is not a map. */
+			Node value(const size_t idx_i) const;
+
+			/** Find a value in a map by its scalar key.
+			 * @param key_i Key to look for.
+			 * @returns Value node, or a null node if not found. */
+			Node find(const std::string_view & key_i) const;
+
+			/** Append an exact encoding of the content of this node and
+			 * everything below it, e.g. to detect changes between two
+			 * documents. Nodes shared through YAML aliases are encoded once
+			 * and referred to afterwards, so equal encodings mean equal
+			 * content.
+			 * @param out_o String to append the encoding to.
+			 * @param seen_io Encoded nodes by node index, pass the same map
+			 * for all nodes of one encoding. */
+			void encode(std::string & out_o, std::unordered_map<uint32_t, uint32_t> & seen_io) const;
+
+			/** Calculate a hash over the content of this node and everything
+			 * below it, e.g. to detect changes between two documents. The
+			 * content hash is memoised per node, so nodes shared through
+			 * YAML aliases are only hashed once. Not thread-safe.
+			 * @param seed_i Hash to continue from, default the FNV-1a
+			 * offset basis.
+			 * @returns 64-bit FNV-1a over types, sizes and scalars. */
+			uint64_t hash(const uint64_t seed_i = 0xcbf29ce484222325ULL) const;
+
+			/** Check whether this node is not null.
+			 * @returns True if the node has a type other than null. */
+			inline explicit operator bool() const { return type() != null_node; }
+		};
+
+		protected:
+		// Image owned by this instance when not mapped from a file
+		std::vector<uint64_t> buf_a;
+
+		// Start of the image, either in buf_a or in the memory map
+		const char * image_a;
+
+		// Length of the memory map, 0 if not mapped
+		size_t mapsize_a;
+
+		// Memoised content hashes by node index, 0 if not calculated yet
+		mutable std::vector<uint64_t> hashes_a;
+
+		// Release the current image, if any
+		void clear();
+
+		// Validate the layout, nodes and strings of the image at image_a
+		bool validate(const size_t size_i, const std::string & name_i) const;
+
+		public:
+		// Default constructor
+		Data();
+
+		// Copying would duplicate ownership of the memory map
+		Data(const Data & obj_i) = delete;
+		Data & operator=(const Data & obj_i) = delete;
+
+		// Default destructor
+		~Data();
+
+		/** Calculate the checksum over part of an image.
+		 * @param start_i Start of the range, must be 8-byte aligned.
+		 * @param size_i Size of the range, must be a multiple of 8.
+		 * @returns 64-bit FNV-1a over the 64-bit words in the range. */
+		static uint64_t checksum(const char * start_i, const size_t size_i);
+
+		/** Check whether a document is loaded.
+		 * @returns True if an image is available. */
+		inline bool empty() const { return image_a == nullptr; }
+
+		/** Get the header of the image.
+		 * @returns Reference to the image header.
+		 * @throws std::logic_error when no document is loaded. */
+		const Header & header() const;
+
+		/** Load a data file. Precompiled files are recognized by their
+		 * magic and mapped into memory, anything else is parsed as YAML.
+		 * @param filename_i Name of the file to load.
+		 * @returns True if successful, false if not. */
+		bool load(const std::string & filename_i);
+
+		/** Map a precompiled data file into memory.
+		 * @param filename_i Name of the .clted file.
+		 * @returns True if successful, false if not. */
+		bool map(const std::string & filename_i);
+
+		/** Get a node by its index in the node array.
+		 * @param idx_i Node index.
+		 * @returns Node at that index.
+		 * @throws std::out_of_range when @p idx_i is out of range. */
+		Node node(const uint32_t idx_i) const;
+
+		/** Get the root node of the document.
+		 * @returns Root node, null if no document is loaded. */
+		Node root() const;
+
+		/** Save the image as a precompiled data file.
+		 * @param filename_i Name of the file to write.
+		 * @returns True if successful, false if not. */
+		bool save(const std::string & filename_i) const;
+
+		/** Get a string from the string table.
+		 * @param idx_i String index.
+		 * @returns View on the string.
+		 * @throws std::out_of_range when @p idx_i is out of range. */
+		std::string_view string(const uint32_t idx_i) const;
+
+		/** Stream a YAML file whose top-level node is a sequence, one
+		 * element at a time. Each element is built into its own image and
+		 * handed to @p element_i as soon as it is parsed, so memory use is
+		 * bounded by the size of a single element. A document that is not
+		 * a sequence is handed over as a whole.
+		 * @param filename_i Name of the YAML file.
+		 * @param element_i Callback receiving each element.
+		 * @returns Number of elements streamed.
+		 * @throws std::runtime_error when the file can't be read or parsed,
+		 * or when an alias refers to an anchor in another element. */
+		static size_t stream(const std::string & filename_i, const std::function<void(Data &)> & element_i);
+
+		/** Read a YAML document from a stream and build the image from it.
+		 * @param in_i Input stream to read from.
+		 * @param name_i Name of the input, used in log messages.
+		 * @returns True if successful, false if not. */
+		bool yaml(std::istream & in_i, const std::string & name_i);
+
+		/** Read a YAML file and build the image from it.
+		 * @param filename_i Name of the YAML file.
+		 * @returns True if successful, false if not. */
+		bool yaml(const std::string & filename_i);
+	};
+
+} // Clte namespace
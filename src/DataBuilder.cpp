@@ -0,0 +1,244 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <cstring>
+#include <stdexcept>
+#include <yaml-cpp/mark.h>
+#include "Logger.h"
+#include "DataBuilder.h"
+#include "Memory.h"
+
+namespace Clte
+{
+
+	namespace
+	{
+
+		// Round a size up to a multiple of 8 bytes
+		inline size_t align8(const size_t size_i)
+		{
+			return (size_i + 7) & ~static_cast<size_t>(7);
+		}
+
+	} // Anonymous namespace
+
+	DataBuilder::DataBuilder(const element_t & element_i)
+	: element_a(element_i), elements_a(0), root_a(0), done_a(false)
+	{ }
+
+	void DataBuilder::anchor(const YAML::anchor_t anchor_i, const uint32_t idx_i)
+	{
+		if (anchor_i != YAML::NullAnchor) anchors_a[anchor_i] = idx_i;
+	}
+
+	void DataBuilder::attach(const uint32_t idx_i)
+	{
+		if (!stack_a.empty()) {
+			if (element_a && stack_a.size() == 1 && stack_a.front().type == Data::sequence_node) {
+				// Complete top-level sequence element, stream it
+				Data dt;
+				root_a = idx_i;
+				done_a = true;
+				finish(dt);
+				elements_a++;
+				element_a(dt);
+				reset();
+				return;
+			}
+			stack_a.back().kids.push_back(idx_i);
+			return;
+		}
+
+		root_a = idx_i;
+		done_a = true;
+
+		// A streamed top-level sequence has already been handed out
+		if (element_a && entries_a[idx_i].type != Data::sequence_node) {
+			Data dt;
+			finish(dt);
+			elements_a++;
+			element_a(dt);
+		}
+	}
+
+	void DataBuilder::finish(Data & data_o)
+	{
+		Data::Header hdr;
+		size_t off = sizeof(Data::Header);
+
+		LCET(done_a, std::logic_error, "No complete YAML document was built");
+		memset(&hdr, 0, sizeof(hdr));
+		memcpy(hdr.magic, Data::magic, sizeof(hdr.magic));
+		hdr.version = Data::version;
+		hdr.order = Data::order;
+		hdr.root = root_a;
+		hdr.nodecount = entries_a.size();
+		hdr.childcount = children_a.size();
+		hdr.stringcount = strings_a.size();
+		hdr.nodes = off;
+		off += align8(entries_a.size() * sizeof(Data::Entry));
+		hdr.children = off;
+		off += align8(children_a.size() * sizeof(uint32_t));
+		hdr.strings = off;
+		off += strings_a.size() * sizeof(Data::String);
+		hdr.bytes = off;
+		off += align8(bytes_a.size());
+		hdr.size = off;
+
+		data_o.clear();
+		data_o.buf_a.assign(off / sizeof(uint64_t), 0);
+		char * img = reinterpret_cast<char *>(data_o.buf_a.data());
+		memcpy(img + hdr.nodes, entries_a.data(), entries_a.size() * sizeof(Data::Entry));
+		memcpy(img + hdr.children, children_a.data(), children_a.size() * sizeof(uint32_t));
+		memcpy(img + hdr.strings, strings_a.data(), strings_a.size() * sizeof(Data::String));
+		memcpy(img + hdr.bytes, bytes_a.data(), bytes_a.size());
+		hdr.checksum = Data::checksum(img + sizeof(hdr), off - sizeof(hdr));
+		memcpy(img, &hdr, sizeof(hdr));
+		data_o.image_a = img;
+		Memory::instance()->add(Memory::data_memory, off);
+	}
+
+	uint32_t DataBuilder::intern(const std::string & str_i)
+	{
+		auto it = index_a.find(str_i);
+		if (it != index_a.end()) return it->second;
+
+		uint32_t idx = strings_a.size();
+		strings_a.push_back({ bytes_a.size(), str_i.size() });
+		bytes_a.append(str_i);
+		bytes_a.push_back('\0');
+		index_a.emplace(str_i, idx);
+		return idx;
+	}
+
+	uint32_t DataBuilder::node(const Data::Entry & ent_i)
+	{
+		entries_a.push_back(ent_i);
+		return entries_a.size() - 1;
+	}
+
+	void DataBuilder::reset()
+	{
+		entries_a.clear();
+		children_a.clear();
+		strings_a.clear();
+		bytes_a.clear();
+		index_a.clear();
+		anchors_a.clear();
+		done_a = false;
+	}
+
+	void DataBuilder::OnDocumentStart(const YAML::Mark & mark_i)
+	{
+		UNUSED(mark_i);
+		reset();
+		stack_a.clear();
+	}
+
+	void DataBuilder::OnDocumentEnd()
+	{ }
+
+	void DataBuilder::OnNull(const YAML::Mark & mark_i, YAML::anchor_t anchor_i)
+	{
+		UNUSED(mark_i);
+		uint32_t idx = node({ Data::null_node, 0, 0 });
+		anchor(anchor_i, idx);
+		attach(idx);
+	}
+
+	void DataBuilder::OnAlias(const YAML::Mark & mark_i, YAML::anchor_t anchor_i)
+	{
+		auto it = anchors_a.find(anchor_i);
+
+		// Nodes can be shared, but only within the image being built.
+		// Anything else would render differently than the loaded document.
+		LCET(it != anchors_a.end(), std::runtime_error,
+			"Line %d: alias refers to an anchor outside the current element, which is not supported when streaming",
+			mark_i.line + 1);
+		attach(it->second);
+	}
+
+	void DataBuilder::OnScalar(const YAML::Mark & mark_i, const std::string & tag_i,
+		YAML::anchor_t anchor_i, const std::string & value_i)
+	{
+		UNUSED(mark_i);
+		UNUSED(tag_i);
+		uint32_t idx = node({ Data::scalar_node, 0, intern(value_i) });
+		anchor(anchor_i, idx);
+		attach(idx);
+	}
+
+	void DataBuilder::OnSequenceStart(const YAML::Mark & mark_i, const std::string & tag_i,
+		YAML::anchor_t anchor_i, YAML::EmitterStyle::value style_i)
+	{
+		UNUSED(mark_i);
+		UNUSED(tag_i);
+		UNUSED(style_i);
+		stack_a.push_back({ Data::sequence_node, anchor_i, {} });
+	}
+
+	void DataBuilder::OnSequenceEnd()
+	{
+		Frame frm = std::move(stack_a.back());
+		stack_a.pop_back();
+
+		// Children of a collection are stored contiguously
+		uint32_t idx = node({ Data::sequence_node, static_cast<uint32_t>(frm.kids.size()),
+			static_cast<uint32_t>(children_a.size()) });
+		children_a.insert(children_a.end(), frm.kids.begin(), frm.kids.end());
+		anchor(frm.anchor, idx);
+		attach(idx);
+	}
+
+	void DataBuilder::OnMapStart(const YAML::Mark & mark_i, const std::string & tag_i,
+		YAML::anchor_t anchor_i, YAML::EmitterStyle::value style_i)
+	{
+		UNUSED(mark_i);
+		UNUSED(tag_i);
+		UNUSED(style_i);
+		stack_a.push_back({ Data::map_node, anchor_i, {} });
+	}
+
+	void DataBuilder::OnMapEnd()
+	{
+		Frame frm = std::move(stack_a.back());
+		stack_a.pop_back();
+
+		// Keys and values alternate in the child index array
+		uint32_t idx = node({ Data::map_node, static_cast<uint32_t>(frm.kids.size() / 2),
+			static_cast<uint32_t>(children_a.size()) });
+		children_a.insert(children_a.end(), frm.kids.begin(), frm.kids.end());
+		anchor(frm.anchor, idx);
+		attach(idx);
+	}
+
+} // Clte namespace
@@ -0,0 +1,144 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <yaml-cpp/eventhandler.h>
+#include "Data.h"
+
+namespace Clte
+{
+
+	/** Builds Data images straight from YAML parser events, without
+	 * constructing an intermediate YAML::Node tree. In streaming mode every
+	 * element of a top-level sequence is handed out as a separate image as
+	 * soon as it is complete, after which its memory is reused for the next
+	 * element. */
+	class DataBuilder : public YAML::EventHandler
+	{
+		public:
+		/// Callback receiving a complete document or sequence element
+		typedef std::function<void(Data &)> element_t;
+
+		protected:
+		/// Collection currently being built
+		struct Frame {
+			Data::type_t type;           ///< Sequence or map
+			YAML::anchor_t anchor;       ///< Anchor of the collection
+			std::vector<uint32_t> kids;  ///< Node indices of the children
+		};
+
+		// Node array
+		std::vector<Data::Entry> entries_a;
+
+		// Child index array
+		std::vector<uint32_t> children_a;
+
+		// String table
+		std::vector<Data::String> strings_a;
+
+		// String bytes, including NUL terminators
+		std::string bytes_a;
+
+		// Deduplication of strings, maps string to string index
+		std::unordered_map<std::string, uint32_t> index_a;
+
+		// Anchored nodes, maps anchor to node index
+		std::unordered_map<YAML::anchor_t, uint32_t> anchors_a;
+
+		// Collections currently open
+		std::vector<Frame> stack_a;
+
+		// Callback for complete elements, empty when not streaming
+		element_t element_a;
+
+		// Number of elements handed out in streaming mode
+		size_t elements_a;
+
+		// Index of the root node once the document is complete
+		uint32_t root_a;
+
+		// True once a complete document has been built
+		bool done_a;
+
+		// Add a node to the innermost open collection or make it the root
+		void attach(const uint32_t idx_i);
+
+		// Register a node under its anchor
+		void anchor(const YAML::anchor_t anchor_i, const uint32_t idx_i);
+
+		// Add a string to the string table if not present yet
+		uint32_t intern(const std::string & str_i);
+
+		// Add an entry to the node array, returns its index
+		uint32_t node(const Data::Entry & ent_i);
+
+		// Forget all nodes and strings collected so far
+		void reset();
+
+		public:
+		/** Constructor.
+		 * @param element_i Callback to stream top-level sequence elements
+		 * to. If empty (default), the whole document is built at once. */
+		DataBuilder(const element_t & element_i = element_t());
+
+		/** Get the number of elements handed out in streaming mode.
+		 * @returns Number of top-level sequence elements streamed. */
+		inline size_t elements() const { return elements_a; }
+
+		/** Serialize the document built so far into a Data image.
+		 * @param data_o Data instance to hand the image to.
+		 * @throws std::logic_error when no complete document was built. */
+		void finish(Data & data_o);
+
+		/** @{ YAML::EventHandler implementation */
+		void OnDocumentStart(const YAML::Mark & mark_i) override;
+		void OnDocumentEnd() override;
+		void OnNull(const YAML::Mark & mark_i, YAML::anchor_t anchor_i) override;
+		void OnAlias(const YAML::Mark & mark_i, YAML::anchor_t anchor_i) override;
+		void OnScalar(const YAML::Mark & mark_i, const std::string & tag_i,
+			YAML::anchor_t anchor_i, const std::string & value_i) override;
+		void OnSequenceStart(const YAML::Mark & mark_i, const std::string & tag_i,
+			YAML::anchor_t anchor_i, YAML::EmitterStyle::value style_i) override;
+		void OnSequenceEnd() override;
+		void OnMapStart(const YAML::Mark & mark_i, const std::string & tag_i,
+			YAML::anchor_t anchor_i, YAML::EmitterStyle::value style_i) override;
+		void OnMapEnd() override;
+		/** @} */
+	};
+
+} // Clte namespace
@@ -30,22 +30,59 @@
  *
  * vim:set ts=4 sw=4 noet: */
 
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include "Logger.h"
 #include "Driver.h"
+#include "Scanner.h"
+#include "Stats.h"
 
 namespace Clte
 {
 
 	Driver::Driver() { }
 
+	Driver::~Driver() { }
+
+	yy::parser::symbol_type Driver::lex()
+	{
+		return scanner_a->lex(*this);
+	}
+
 	bool Driver::parse(const std::string & tplfname_i)
 	{
-		tplfname_a = tplfname_i;
+		if (tplfname_i.empty()) return parse(std::cin, "stdin");
+
+		std::ifstream ifs(tplfname_i);
+		LCER(ifs.good(), false, "Unable to open template file %s", tplfname_i.c_str());
+		return parse(ifs, tplfname_i);
+	}
+
+	bool Driver::parse(std::istream & in_i, const std::string & name_i)
+	{
+		Stats::Timer tmr(Stats::parse_time);
+
+		tplfname_a = name_i;
 		loc_a.initialize(&tplfname_a);
+		tpl_a.reset(new Template(name_i));
+		scanner_a.reset(new Scanner(&in_i));
 		scan_begin();
 		yy::parser prsr(*this);
 		int res = prsr();
 		scan_end();
-		return res == 0;
+		scanner_a.reset();
+
+		if (res != 0) {
+			tpl_a.reset();
+			return false;
+		}
+
+		size_t merged = tpl_a->merge();
+		tpl_a->account();
+		LD("Compiled %s into %zu nodes using %zu arena bytes, merged %zu literals",
+			name_i.c_str(), tpl_a->nodes(), tpl_a->bytes(), merged);
+		return true;
 	}
 
 } // Clte namespace
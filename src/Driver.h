@@ -32,16 +32,20 @@
 
 #pragma once
 
+#include <istream>
+#include <memory>
 #include <string>
-
-#define YY_DECL \
-	yy::parser::symbol_type yylex(Clte::Driver & drv_i)
-
-YY_DECL;
+#include "parser.hh"
+#include "Template.h"
 
 namespace Clte
 {
 
+	class Scanner;
+
+	/** Drives scanning and parsing of a single template. All parse state is
+	 * kept in the instance, so separate Drivers can parse templates in
+	 * parallel threads. */
 	class Driver
 	{
 		protected:
@@ -51,18 +55,46 @@ namespace Clte
 		// Template filename we are reading
 		std::string tplfname_a;
 
+		// Scanner for the template being parsed, only set during parse()
+		std::unique_ptr<Scanner> scanner_a;
+
+		// Template being built, owns the arena of the current parse
+		std::unique_ptr<Template> tpl_a;
+
 		public:
 		// Default constructor
 		Driver();
 
 		// Default destructor
-		~Driver();
+		virtual ~Driver();
+
+		/** Scan the next token, called by the parser.
+		 * @returns Next token from the template being parsed. */
+		yy::parser::symbol_type lex();
+
+		/** Get the location of the current token.
+		 * @returns Reference to the token location. */
+		inline yy::location & location() { return loc_a; }
 
 		/** Parse a template input file
 		 * @param tplfname_i Template filename, default is "", meaning stdin
 		 * @returns True if successful, false if a failure occurred. */
 		bool parse(const std::string & tplfname_i = "");
 
+		/** Parse a template from an input stream.
+		 * @param in_i Input stream to read the template from.
+		 * @param name_i Name of the template, used in error messages.
+		 * @returns True if successful, false if a failure occurred. */
+		bool parse(std::istream & in_i, const std::string & name_i);
+
+		/** Take over the template built by the last successful parse().
+		 * @returns Compiled template, NULL if there is none. */
+		inline std::unique_ptr<Template> release() { return std::move(tpl_a); }
+
+		/** Get the template being built, for use by scanner and parser.
+		 * @returns Reference to the template. */
+		inline Template & tpl() { return *tpl_a; }
+
 		/** Handle the start of scanning. */
 		virtual inline void scan_begin() { }
 
@@ -0,0 +1,82 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include "Emit.h"
+#include "Memory.h"
+#include "Stats.h"
+
+namespace Clte
+{
+
+	static_assert(Emitter::bufsize >= Emit::large, "Emitter buffer must hold runs copied by value");
+
+	Emitter::Emitter(std::ostream & out_i, const bool sink_i)
+	: out_a(&out_i), sink_a(sink_i ? &out_i : nullptr), buf_a(new char[bufsize]), pos_a(buf_a.get()), end_a(buf_a.get() + bufsize)
+	{
+		Memory::instance()->add(Memory::output_memory, bufsize);
+	}
+
+	Emitter::~Emitter()
+	{
+		flush();
+		Memory::instance()->sub(Memory::output_memory, bufsize);
+	}
+
+	bool Emitter::flush()
+	{
+		if (pos_a != buf_a.get()) {
+			put(buf_a.get(), pos_a - buf_a.get());
+			pos_a = buf_a.get();
+		}
+		return out_a->good();
+	}
+
+	void Emitter::put(const char * str_i, const size_t len_i)
+	{
+		// Fragment captures and background writers are counted later
+		if (out_a != sink_a) {
+			out_a->write(str_i, len_i);
+			return;
+		}
+
+		Stats::Timer tmr(Stats::write_time);
+		out_a->write(str_i, len_i);
+		Stats::add(Stats::bytes_out, len_i);
+	}
+
+	void Emitter::target(std::ostream & out_i)
+	{
+		flush();
+		out_a = &out_i;
+	}
+
+} // Clte namespace
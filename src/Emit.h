@@ -0,0 +1,201 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <string_view>
+
+namespace Clte
+{
+
+	/** Emit routines specialised by the size of the copied run. Short runs
+	 * are copied with a few fixed-size, overlapping moves that the compiler
+	 * inlines, medium runs with memcpy() and large runs are handed to the
+	 * output stream by reference, without copying them into a buffer. The
+	 * size class of each literal is determined once when compiling the
+	 * template, so rendering only dispatches on it. */
+	namespace Emit
+	{
+
+		/// Size classes of runs
+		enum class_t : uint8_t {
+			inline16 = 0,  ///< Up to 16 bytes, copied inline
+			inline32 = 1,  ///< Up to 32 bytes, copied inline
+			inline64 = 2,  ///< Up to 64 bytes, copied inline
+			copy = 3,      ///< Up to Emit::large bytes, copied with memcpy()
+			reference = 4  ///< Written directly from the source
+		};
+
+		/// Runs larger than this are written by reference
+		constexpr size_t large = 4096;
+
+		/** Determine the size class of a run.
+		 * @param len_i Length of the run.
+		 * @returns Size class. */
+		constexpr class_t classify(const size_t len_i)
+		{
+			if (len_i <= 16) return inline16;
+			if (len_i <= 32) return inline32;
+			if (len_i <= 64) return inline64;
+			if (len_i <= large) return copy;
+			return reference;
+		}
+
+		/** Copy up to N bytes with fixed-size moves. A run longer than half
+		 * of N is copied as two overlapping blocks of N/2 bytes, shorter
+		 * runs are handed to the next smaller size.
+		 * @param dst_i Destination, with room for @p len_i bytes.
+		 * @param src_i Source.
+		 * @param len_i Number of bytes, at most N. */
+		template <size_t N>
+		inline void small(char * dst_i, const char * src_i, const size_t len_i)
+		{
+			static_assert(N >= 4 && (N & (N - 1)) == 0, "Size must be a power of 2 of at least 4");
+
+			if (len_i > N / 2) {
+				memcpy(dst_i, src_i, N / 2);
+				memcpy(dst_i + len_i - N / 2, src_i + len_i - N / 2, N / 2);
+				return;
+			}
+			if constexpr (N > 4) {
+				small<N / 2>(dst_i, src_i, len_i);
+			} else {
+				// Up to 2 bytes left
+				if (len_i == 0) return;
+				dst_i[0] = src_i[0];
+				dst_i[len_i - 1] = src_i[len_i - 1];
+			}
+		}
+
+	} // Emit namespace
+
+	/** Output buffer in front of an output stream, filled with the size
+	 * class specific emit routines. */
+	class Emitter
+	{
+		protected:
+		// Output stream to write to
+		std::ostream * out_a;
+
+		// Output stream whose writes are counted in Stats, NULL if none
+		std::ostream * sink_a;
+
+		// Buffer
+		std::unique_ptr<char[]> buf_a;
+
+		// Current position in buf_a
+		char * pos_a;
+
+		// End of buf_a
+		char * end_a;
+
+		// Write to the output stream, counting time and bytes in Stats
+		// when it is the sink
+		void put(const char * str_i, const size_t len_i);
+
+		public:
+		/// Size of the buffer, must hold at least Emit::large bytes
+		static constexpr size_t bufsize = 64 * 1024;
+
+		/** Constructor.
+		 * @param out_i Output stream to write to.
+		 * @param sink_i True if @p out_i is where the output ends up, so
+		 * writes to it are counted in Stats. Other streams count the
+		 * output where they finally write it. */
+		Emitter(std::ostream & out_i, const bool sink_i = true);
+
+		// Copying would write buffered output twice
+		Emitter(const Emitter & obj_i) = delete;
+		Emitter & operator=(const Emitter & obj_i) = delete;
+
+		// Destructor, flushes the buffer
+		~Emitter();
+
+		/** Write the buffered output to the output stream.
+		 * @returns True if the output stream is still good. */
+		bool flush();
+
+		/** Get the output stream currently written to.
+		 * @returns Reference to the output stream. */
+		inline std::ostream & stream() const { return *out_a; }
+
+		/** Switch to another output stream. Output buffered so far is
+		 * written to the current one first.
+		 * @param out_i Output stream to write following output to. */
+		void target(std::ostream & out_i);
+
+		/** Emit a run of a known size class.
+		 * @param str_i Run to emit, its size must fit in class C. For
+		 * Emit::reference, the buffered output is flushed and the run is
+		 * written to the output stream at once, without copying it. */
+		template <Emit::class_t C>
+		inline void emit(const std::string_view & str_i)
+		{
+			size_t len = str_i.size();
+
+			if constexpr (C == Emit::reference) {
+				flush();
+				put(str_i.data(), len);
+			} else {
+				if (static_cast<size_t>(end_a - pos_a) < len) flush();
+				if constexpr (C == Emit::inline16) Emit::small<16>(pos_a, str_i.data(), len);
+				else if constexpr (C == Emit::inline32) Emit::small<32>(pos_a, str_i.data(), len);
+				else if constexpr (C == Emit::inline64) Emit::small<64>(pos_a, str_i.data(), len);
+				else memcpy(pos_a, str_i.data(), len);
+				pos_a += len;
+			}
+		}
+
+		/** Emit a run of a size class determined beforehand.
+		 * @param str_i Run to emit.
+		 * @param class_i Size class of @p str_i, see Emit::classify(). */
+		inline void emit(const std::string_view & str_i, const Emit::class_t class_i)
+		{
+			switch (class_i) {
+				case Emit::inline16: emit<Emit::inline16>(str_i); break;
+				case Emit::inline32: emit<Emit::inline32>(str_i); break;
+				case Emit::inline64: emit<Emit::inline64>(str_i); break;
+				case Emit::copy: emit<Emit::copy>(str_i); break;
+				case Emit::reference: emit<Emit::reference>(str_i); break;
+			}
+		}
+
+		/** Emit a run of any size.
+		 * @param str_i Run to emit. */
+		inline void write(const std::string_view & str_i) { emit(str_i, Emit::classify(str_i.size())); }
+	};
+
+} // Clte namespace
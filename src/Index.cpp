@@ -0,0 +1,147 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include "Index.h"
+#include "Logger.h"
+#include "Stats.h"
+
+namespace Clte
+{
+
+	size_t Index::build(const Data & data_i)
+	{
+		Stats::Timer tmr(Stats::index_time);
+		std::vector<std::string> specs(declared_a);
+		size_t count = 0;
+
+		clear();
+		if (data_i.empty()) return 0;
+
+		// Declarations in the data file itself
+		Data::Node hdr = data_i.root().find(header);
+		if (hdr.type() == Data::scalar_node) {
+			specs.emplace_back(hdr.scalar());
+		} else if (hdr.type() == Data::sequence_node) {
+			for (size_t i = 0; i < hdr.size(); i++) specs.emplace_back(hdr[i].scalar());
+		}
+
+		for (const std::string & spec : specs) {
+			Field fld;
+			if (indexes_a.count(spec) > 0) continue;
+			if (!split(spec, fld.path, fld.field)) {
+				LW("Ignoring malformed index '%s' in %s", spec.c_str(), header);
+				continue;
+			}
+			count += build(data_i, fld);
+			indexes_a.emplace(spec, std::move(fld));
+		}
+
+		LD("Built %zu data indexes with %zu values", indexes_a.size(), count);
+		return count;
+	}
+
+	size_t Index::build(const Data & data_i, Field & field_o)
+	{
+		Data::Node coll = data_i.root();
+		size_t start = 0, count = 0;
+
+		while (coll && start < field_o.path.size()) {
+			size_t end = field_o.path.find('.', start);
+			if (end == std::string::npos) end = field_o.path.size();
+			coll = coll.find(std::string_view(field_o.path).substr(start, end - start));
+			start = end + 1;
+		}
+		if (coll.type() != Data::sequence_node && coll.type() != Data::map_node) {
+			LW("Index %s:%s doesn't refer to a sequence or map", field_o.path.c_str(), field_o.field.c_str());
+			return 0;
+		}
+
+		bool seq = coll.type() == Data::sequence_node;
+		for (size_t i = 0; i < coll.size(); i++) {
+			Data::Node elem = seq ? coll[i] : coll.value(i);
+			Data::Node val = elem.find(field_o.field);
+
+			if (val.type() == Data::scalar_node) {
+				field_o.entries[val.scalar()].push_back(elem.index());
+				count++;
+			} else if (val.type() == Data::sequence_node) {
+				for (size_t j = 0; j < val.size(); j++) {
+					if (val[j].type() != Data::scalar_node) continue;
+
+					// An element listing a value twice is found once
+					std::vector<uint32_t> & nodes = field_o.entries[val[j].scalar()];
+					if (!nodes.empty() && nodes.back() == elem.index()) continue;
+					nodes.push_back(elem.index());
+					count++;
+				}
+			}
+		}
+
+		return count;
+	}
+
+	void Index::clear()
+	{
+		indexes_a.clear();
+	}
+
+	bool Index::declare(const std::string & spec_i)
+	{
+		std::string path, field;
+
+		LCER(split(spec_i, path, field), false, "Malformed index '%s', expected path:field", spec_i.c_str());
+		declared_a.push_back(spec_i);
+		return true;
+	}
+
+	bool Index::find(const std::string_view & spec_i, const std::string_view & key_i, const std::vector<uint32_t> * & nodes_o) const
+	{
+		auto it = indexes_a.find(spec_i);
+
+		nodes_o = nullptr;
+		if (it == indexes_a.end()) return false;
+		auto ent = it->second.entries.find(key_i);
+		if (ent != it->second.entries.end()) nodes_o = &ent->second;
+		return true;
+	}
+
+	bool Index::split(const std::string & spec_i, std::string & path_o, std::string & field_o)
+	{
+		size_t colon = spec_i.rfind(':');
+
+		if (colon == std::string::npos || colon + 1 == spec_i.size()) return false;
+		path_o = spec_i.substr(0, colon);
+		field_o = spec_i.substr(colon + 1);
+		return true;
+	}
+
+} // Clte namespace
@@ -0,0 +1,113 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "Data.h"
+
+namespace Clte
+{
+
+	/** Secondary hash indexes over the sequences of a Data document. An
+	 * index is declared as "path:field", where path is a dot separated list
+	 * of map keys leading from the root to a sequence (or map) and field is
+	 * a key of its elements. Building the index maps every scalar value of
+	 * that field, or every scalar in it when the field is a sequence, to the
+	 * elements having it, so finding them is a hash lookup instead of a
+	 * linear scan. Indexes are also declared by the data file itself, as a
+	 * sequence of such strings under the top-level key "clte-indexes". */
+	class Index
+	{
+		public:
+		/// Top-level key of the data file header declaring indexes
+		static constexpr const char * header = "clte-indexes";
+
+		protected:
+		/// Single index
+		struct Field {
+			std::string path;  ///< Path of the sequence, empty for the root
+			std::string field; ///< Field of the elements to index
+			std::unordered_map<std::string_view, std::vector<uint32_t> > entries; ///< Node indices of the elements by value
+		};
+
+		// Indexes by their declaration, found without copying the
+		// declaration passed to find()
+		std::map<std::string, Field, std::less<> > indexes_a;
+
+		// Declarations given with declare(), kept when rebuilding
+		std::vector<std::string> declared_a;
+
+		// Build a single index over a document
+		size_t build(const Data & data_i, Field & field_o);
+
+		// Split a declaration into its path and field
+		static bool split(const std::string & spec_i, std::string & path_o, std::string & field_o);
+
+		public:
+		/** Build all declared indexes over a document, including the ones
+		 * declared by the document. Indexes of a previous document are
+		 * dropped. The indexes refer to the document, so it has to stay
+		 * loaded while they are used.
+		 * @param data_i Document to index.
+		 * @returns Number of indexed values. */
+		size_t build(const Data & data_i);
+
+		/** Drop all indexes built, keeping the declarations. */
+		void clear();
+
+		/** Declare an index to build.
+		 * @param spec_i Declaration, "path:field".
+		 * @returns True if successful, false if the declaration is
+		 * malformed. */
+		bool declare(const std::string & spec_i);
+
+		/** Look up the elements having a value in an index.
+		 * @param spec_i Declaration of the index.
+		 * @param key_i Value to look up.
+		 * @param nodes_o Set to the node indices of the elements in
+		 * document order, NULL if there are none.
+		 * @returns True if the index exists, false if not. */
+		bool find(const std::string_view & spec_i, const std::string_view & key_i, const std::vector<uint32_t> * & nodes_o) const;
+
+		/** Get the number of indexes built.
+		 * @returns Number of indexes. */
+		inline size_t size() const { return indexes_a.size(); }
+	};
+
+} // Clte namespace
@@ -0,0 +1,310 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <cerrno>
+#include <cstring>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+#include "IoWriter.h"
+#include "Logger.h"
+#include "Stats.h"
+
+namespace Clte
+{
+
+	IoWriter::~IoWriter()
+	{
+	}
+
+	std::unique_ptr<IoWriter> IoWriter::create(const size_t threads_i)
+	{
+#ifdef HAVE_LIBURING
+		std::unique_ptr<UringWriter> uring(new UringWriter());
+		if (uring->ok()) return uring;
+		LD("io_uring not usable, falling back to a thread pool");
+#endif
+		return std::unique_ptr<IoWriter>(new PoolWriter(threads_i));
+	}
+
+	bool IoWriter::run(Job & job_i)
+	{
+		File & fil = *job_i.file;
+
+		if (fil.fd < 0) {
+			int flags = O_WRONLY | O_CREAT | (fil.created ? O_APPEND : O_TRUNC);
+			fil.fd = open(fil.path.c_str(), flags, 0666);
+			LCER(fil.fd >= 0, false, "Unable to open output file %s: %s", fil.path.c_str(), strerror(errno));
+			fil.created = true;
+		}
+
+		const char * pos = job_i.data.data();
+		size_t left = job_i.data.size();
+		while (left > 0) {
+			ssize_t res = ::write(fil.fd, pos, left);
+			if (res < 0 && errno == EINTR) continue;
+			LCER(res > 0, false, "Unable to write output file %s: %s", fil.path.c_str(), strerror(errno));
+			pos += res;
+			left -= res;
+			fil.size += res;
+			Stats::add(Stats::bytes_out, res);
+		}
+
+		if (job_i.close) {
+			int res = ::close(fil.fd);
+			fil.fd = -1;
+			LCER(res == 0, false, "Unable to close output file %s: %s", fil.path.c_str(), strerror(errno));
+		}
+		return true;
+	}
+
+	PoolWriter::PoolWriter(const size_t threads_i)
+	: queues_a(threads_i > 0 ? threads_i : 1), pending_a(0), done_a(false), failed_a(false)
+	{
+		for (size_t i = 0; i < queues_a.size(); i++) threads_a.emplace_back(&PoolWriter::worker, this, i);
+	}
+
+	PoolWriter::~PoolWriter()
+	{
+		{
+			GRD(mux_a);
+			done_a = true;
+		}
+		work_a.notify_all();
+		for (std::thread & thr : threads_a) thr.join();
+	}
+
+	void PoolWriter::worker(const size_t idx_i)
+	{
+		std::deque<Job *> & queue = queues_a[idx_i];
+		std::unique_lock<std::mutex> lck(mux_a);
+
+		for (;;) {
+			work_a.wait(lck, [this, &queue]() { return done_a || !queue.empty(); });
+			if (queue.empty()) break;
+
+			Job * job = queue.front();
+			queue.pop_front();
+			lck.unlock();
+
+			bool good = run(*job);
+
+			lck.lock();
+			if (!good) failed_a = true;
+			if (--pending_a == 0) idle_a.notify_all();
+		}
+	}
+
+	bool PoolWriter::write(std::vector<Job> & jobs_i)
+	{
+		if (jobs_i.empty()) return true;
+
+		std::unique_lock<std::mutex> lck(mux_a);
+		failed_a = false;
+		pending_a = jobs_i.size();
+		for (Job & job : jobs_i) queues_a[job.file->index % queues_a.size()].push_back(&job);
+		lck.unlock();
+		work_a.notify_all();
+
+		lck.lock();
+		idle_a.wait(lck, [this]() { return pending_a == 0; });
+		return !failed_a;
+	}
+
+#ifdef HAVE_LIBURING
+	UringWriter::UringWriter(const unsigned int entries_i, const unsigned int slots_i)
+	: ok_a(false)
+	{
+		int res = io_uring_queue_init(entries_i, &ring_a, 0);
+		LCER(res == 0, , "Unable to set up io_uring: %s", strerror(-res));
+
+		struct io_uring_probe * probe = io_uring_get_probe_ring(&ring_a);
+		ok_a = probe && io_uring_opcode_supported(probe, IORING_OP_OPENAT) &&
+			io_uring_opcode_supported(probe, IORING_OP_WRITE) && io_uring_opcode_supported(probe, IORING_OP_CLOSE);
+		if (probe) io_uring_free_probe(probe);
+
+		// Sparse registration came with direct descriptors for open and close
+		if (ok_a) ok_a = io_uring_register_files_sparse(&ring_a, slots_i) == 0;
+		if (!ok_a) {
+			io_uring_queue_exit(&ring_a);
+			return;
+		}
+
+		for (unsigned int i = slots_i; i > 0; i--) slots_a.push_back(i - 1);
+	}
+
+	UringWriter::~UringWriter()
+	{
+		if (ok_a) io_uring_queue_exit(&ring_a);
+	}
+
+	bool UringWriter::write(std::vector<Job> & jobs_i)
+	{
+		/// Submitted operation
+		struct Op {
+			Job * job;      ///< Job the operation belongs to
+			int kind;       ///< 0 for open, 1 for write, 2 for close
+			size_t expect;  ///< Expected result of a write
+		};
+		static const char * const verbs[] = { "open", "write", "close" };
+
+		// Jobs not submitted yet, in order
+		std::deque<Job *> left;
+		for (Job & job : jobs_i) left.push_back(&job);
+
+		std::vector<Op> ops;
+		std::vector<int> release;
+		std::unordered_map<File *, struct io_uring_sqe *> busy;
+		bool good = true;
+
+		// Every round submits one chain of linked operations per file, so
+		// jobs of the same file stay in order while different files proceed
+		// in parallel. Links only bind an operation to the one prepared
+		// right before it, so a job can only continue the chain of its
+		// file when nothing else was prepared in between. Otherwise, or
+		// when the file was closed, it waits for the next round, and so do
+		// all later jobs of that file.
+		while (!left.empty()) {
+			struct io_uring_sqe * prev = nullptr;
+			ops.clear();
+			release.clear();
+			busy.clear();
+
+			for (auto it = left.begin(); it != left.end();) {
+				Job * job = *it;
+				File & fil = *job->file;
+				bool open = fil.slot < 0;
+				unsigned int need = (open ? 1 : 0) + (job->data.empty() ? 0 : 1) + (job->close ? 1 : 0);
+				auto bsy = busy.find(&fil);
+
+				if (bsy != busy.end() && bsy->second != prev) {
+					bsy->second = nullptr;
+					++it;
+					continue;
+				}
+				if (io_uring_sq_space_left(&ring_a) < need || (open && slots_a.empty())) break;
+
+				if (open) {
+					fil.slot = slots_a.back();
+					slots_a.pop_back();
+				}
+
+				// Link the operations so they run in order and a failure
+				// cancels the rest of the chain, continuing the chain of an
+				// earlier job of the file, e.g. the one creating it
+				struct io_uring_sqe * last = bsy == busy.end() ? nullptr : bsy->second;
+				unsigned int done = 0;
+				auto prepare = [&](const int kind_i, const size_t expect_i) {
+					struct io_uring_sqe * sqe = io_uring_get_sqe(&ring_a);
+					unsigned int flags = ++done < need ? IOSQE_IO_LINK : 0;
+
+					if (last != nullptr) io_uring_sqe_set_flags(last, last->flags | IOSQE_IO_LINK);
+					last = sqe;
+					prev = sqe;
+
+					if (kind_i == 0) {
+						int mode = O_WRONLY | O_CREAT | (fil.created ? O_APPEND : O_TRUNC);
+						io_uring_prep_openat_direct(sqe, AT_FDCWD, fil.path.c_str(), mode, 0666, fil.slot);
+					} else if (kind_i == 1) {
+						io_uring_prep_write(sqe, fil.slot, job->data.data(), job->data.size(), fil.size);
+						flags |= IOSQE_FIXED_FILE;
+					} else {
+						io_uring_prep_close_direct(sqe, fil.slot);
+					}
+					io_uring_sqe_set_flags(sqe, flags);
+					io_uring_sqe_set_data64(sqe, ops.size());
+					ops.push_back(Op{ job, kind_i, expect_i });
+				};
+
+				if (open) prepare(0, 0);
+				if (!job->data.empty()) prepare(1, job->data.size());
+				if (job->close) prepare(2, 0);
+
+				fil.size += job->data.size();
+				if (job->close) {
+					release.push_back(fil.slot);
+					fil.slot = -1;
+				}
+				busy[&fil] = job->close ? nullptr : last;
+				it = left.erase(it);
+			}
+
+			if (ops.empty()) {
+				if (left.empty()) break;
+				LE("No io_uring file slot left for output file %s", left.front()->file->path.c_str());
+				return false;
+			}
+
+			int res = io_uring_submit_and_wait(&ring_a, ops.size());
+			LCER(res >= 0, false, "Unable to submit to io_uring: %s", strerror(-res));
+
+			for (size_t i = 0; i < ops.size(); i++) {
+				struct io_uring_cqe * cqe;
+				res = io_uring_wait_cqe(&ring_a, &cqe);
+				LCER(res == 0, false, "Unable to wait for io_uring: %s", strerror(-res));
+
+				Op & op = ops[io_uring_cqe_get_data64(cqe)];
+				int val = cqe->res;
+				io_uring_cqe_seen(&ring_a, cqe);
+
+				// A short write is an error since it cancels the chain
+				bool fine = val >= 0 && (op.kind != 1 || static_cast<size_t>(val) == op.expect);
+				if (op.kind == 1 && val > 0) Stats::add(Stats::bytes_out, val);
+
+				// Appending is only right once the file was really created,
+				// after a failed open it is truncated on the next attempt
+				if (op.kind == 0 && fine) op.job->file->created = true;
+
+				if (!fine && val != -ECANCELED) {
+					LE("Unable to %s output file %s: %s", verbs[op.kind], op.job->file->path.c_str(),
+						val < 0 ? strerror(-val) : "short write");
+				}
+				if (!fine) {
+					good = false;
+
+					// The slot stays empty when opening failed
+					File & fil = *op.job->file;
+					if (op.kind == 0 && fil.slot >= 0) {
+						release.push_back(fil.slot);
+						fil.slot = -1;
+					}
+				}
+			}
+
+			slots_a.insert(slots_a.end(), release.begin(), release.end());
+		}
+
+		return good;
+	}
+#endif
+
+} // Clte namespace
@@ -0,0 +1,189 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+namespace Clte
+{
+
+	/** Backend executing the file operations of Outputs in batches. Use
+	 * create() to get the fastest backend available. */
+	class IoWriter
+	{
+		public:
+		/// Output file
+		struct File {
+			std::string path; ///< Path of the file
+			size_t index;     ///< Index in the set of files
+			int fd;           ///< File descriptor, -1 when closed
+			int slot;         ///< Registered file slot, -1 when closed
+			bool created;     ///< True once opened, later opens append
+			uint64_t size;    ///< Bytes written so far
+		};
+
+		/// Operation on a file: open it if needed, write and maybe close
+		struct Job {
+			File * file;            ///< File to write to
+			bool close;             ///< True to close the file after writing
+			std::vector<char> data; ///< Output to write, may be empty
+		};
+
+		protected:
+		/** Execute a job with plain system calls.
+		 * @param job_i Job to execute.
+		 * @returns True if successful, false if not. */
+		static bool run(Job & job_i);
+
+		public:
+		// Default destructor
+		virtual ~IoWriter();
+
+		/** Create the fastest backend available: io_uring when built with
+		 * liburing and supported by the running kernel, a thread pool
+		 * otherwise.
+		 * @param threads_i Number of threads of the thread pool.
+		 * @returns Backend. */
+		static std::unique_ptr<IoWriter> create(const size_t threads_i = 4);
+
+		/** Get the name of the backend.
+		 * @returns Name for log messages. */
+		virtual const char * name() const = 0;
+
+		/** Execute a batch of jobs and wait for all of them. Jobs of the
+		 * same file are executed in order, others in any order.
+		 * @param jobs_i Jobs to execute.
+		 * @returns True if all jobs were successful, false if not. */
+		virtual bool write(std::vector<Job> & jobs_i) = 0;
+	};
+
+	/** Backend executing jobs with plain system calls on a pool of
+	 * threads. All jobs of a file go to the same thread. */
+	class PoolWriter : public IoWriter
+	{
+		protected:
+		// Worker threads
+		std::vector<std::thread> threads_a;
+
+		// Jobs waiting per thread
+		std::vector<std::deque<Job *> > queues_a;
+
+		// Protects queues_a, pending_a, done_a and failed_a
+		std::mutex mux_a;
+
+		// Signals new jobs or done_a to the workers
+		std::condition_variable work_a;
+
+		// Signals finished jobs to write()
+		std::condition_variable idle_a;
+
+		// Number of jobs not finished yet
+		size_t pending_a;
+
+		// Set when the workers have to stop
+		bool done_a;
+
+		// Set when a job of the current batch failed
+		bool failed_a;
+
+		// Worker thread main loop
+		void worker(const size_t idx_i);
+
+		public:
+		/** Constructor, starts the threads.
+		 * @param threads_i Number of threads, at least 1. */
+		PoolWriter(const size_t threads_i);
+
+		// Copying would duplicate the threads
+		PoolWriter(const PoolWriter & obj_i) = delete;
+		PoolWriter & operator=(const PoolWriter & obj_i) = delete;
+
+		// Destructor, stops the threads
+		~PoolWriter();
+
+		// IoWriter implementation
+		const char * name() const override { return "thread pool"; }
+		bool write(std::vector<Job> & jobs_i) override;
+	};
+
+#ifdef HAVE_LIBURING
+	/** Backend submitting opens, writes and closes through io_uring. Every
+	 * job becomes a linked chain of operations on a registered file slot,
+	 * and the chains of many files are submitted with a single system
+	 * call. Needs Linux 5.19 or later. */
+	class UringWriter : public IoWriter
+	{
+		protected:
+		// The ring
+		struct io_uring ring_a;
+
+		// True if the ring is set up and usable
+		bool ok_a;
+
+		// File slots not in use
+		std::vector<int> slots_a;
+
+		public:
+		/** Constructor, sets up the ring. Check ok() afterwards.
+		 * @param entries_i Number of submission queue entries.
+		 * @param slots_i Number of registered file slots. */
+		UringWriter(const unsigned int entries_i = 256, const unsigned int slots_i = 256);
+
+		// Copying would duplicate the ring
+		UringWriter(const UringWriter & obj_i) = delete;
+		UringWriter & operator=(const UringWriter & obj_i) = delete;
+
+		// Destructor, tears down the ring
+		~UringWriter();
+
+		/** Check whether the kernel supports everything needed.
+		 * @returns True if usable, false if not. */
+		inline bool ok() const { return ok_a; }
+
+		// IoWriter implementation
+		const char * name() const override { return "io_uring"; }
+		bool write(std::vector<Job> & jobs_i) override;
+	};
+#endif
+
+} // Clte namespace
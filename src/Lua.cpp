@@ -0,0 +1,283 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <mutex>
+#include <stdexcept>
+#include <cstdlib>
+#include "Logger.h"
+#include "Lua.h"
+#include "Memory.h"
+#include "Stats.h"
+
+namespace Clte
+{
+
+	namespace
+	{
+
+		// Libraries available to templates
+		const luaL_Reg libs[] = {
+			{ "_G", luaopen_base },
+			{ LUA_STRLIBNAME, luaopen_string },
+			{ LUA_TABLIBNAME, luaopen_table },
+			{ LUA_MATHLIBNAME, luaopen_math },
+			{ nullptr, nullptr }
+		};
+
+		// Base library functions that access the file system, load code
+		// (including bytecode that can crash the state), write to stdout
+		// in between the output or control the garbage collector
+		const char * unsafe[] = { "collectgarbage", "dofile", "load", "loadfile", "loadstring", "print", "require", nullptr };
+
+		// Registry field holding the tostring() of the base library
+		const char * tostringkey = "clte.tostring";
+
+		// Allocator accounting all allocations of a state
+		void * allocate(void * ud_i, void * ptr_i, size_t osize_i, size_t nsize_i)
+		{
+			Memory * mem = static_cast<Memory *>(ud_i);
+
+			// Without a block, osize_i holds the type of the new object
+			if (ptr_i == nullptr) osize_i = 0;
+			if (nsize_i == 0) {
+				free(ptr_i);
+				mem->sub(Memory::lua_memory, osize_i);
+				return nullptr;
+			}
+
+			void * ptr = realloc(ptr_i, nsize_i);
+			if (ptr == nullptr) return nullptr;
+			if (ptr_i == nullptr) Stats::add(Stats::lua_allocs, 1);
+			if (nsize_i > osize_i) mem->add(Memory::lua_memory, nsize_i - osize_i);
+			else mem->sub(Memory::lua_memory, osize_i - nsize_i);
+			return ptr;
+		}
+
+		// Convert the value at index 1 to a string like tostring() does, run
+		// as a protected call
+		int convert(lua_State * L)
+		{
+#if LUA_VERSION_NUM < 502
+			lua_getfield(L, LUA_REGISTRYINDEX, tostringkey);
+			lua_pushvalue(L, 1);
+			lua_call(L, 1, 1);
+			if (!lua_isstring(L, -1)) return luaL_error(L, "'tostring' must return a string");
+#else
+			luaL_tolstring(L, 1, nullptr);
+#endif
+			return 1;
+		}
+
+		// Log errors outside of protected calls, Lua aborts afterwards
+		int panic(lua_State * L)
+		{
+			const char * msg = lua_tostring(L, -1);
+			LE("Unprotected Lua error: %s", msg == nullptr ? "(no message)" : msg);
+			return 0;
+		}
+
+	} // Anonymous namespace
+
+	Lua::Lua()
+	: state_a(lua_newstate(&allocate, Memory::instance())), sampled_a(false), accounted_a(0)
+	{
+		if (state_a == nullptr) {
+			// 64-bit LuaJIT refuses custom allocators
+			state_a = luaL_newstate();
+			sampled_a = true;
+		}
+		LCET(state_a != nullptr, std::runtime_error, "Unable to create Lua state");
+		lua_atpanic(state_a, &panic);
+
+		for (const luaL_Reg * lib = libs; lib->func != nullptr; lib++) {
+#if LUA_VERSION_NUM < 502
+			lua_pushcfunction(state_a, lib->func);
+			lua_pushstring(state_a, lib->name);
+			lua_call(state_a, 1, 0);
+#else
+			luaL_requiref(state_a, lib->name, lib->func, 1);
+			lua_pop(state_a, 1);
+#endif
+		}
+
+		// Templates may replace the global tostring()
+		lua_getglobal(state_a, "tostring");
+		lua_setfield(state_a, LUA_REGISTRYINDEX, tostringkey);
+
+		// Hide the string metatable, so templates can't change the string
+		// methods of other templates sharing the state
+		lua_pushliteral(state_a, "");
+		if (lua_getmetatable(state_a, -1)) {
+			lua_pushboolean(state_a, 0);
+			lua_setfield(state_a, -2, "__metatable");
+			lua_pop(state_a, 1);
+		}
+		lua_pop(state_a, 1);
+
+		for (const char ** fnc = unsafe; *fnc != nullptr; fnc++) {
+			lua_pushnil(state_a);
+			lua_setglobal(state_a, *fnc);
+		}
+
+		lua_newtable(state_a);
+		lua_setglobal(state_a, "clte");
+	}
+
+	Lua::~Lua()
+	{
+		lua_close(state_a);
+		if (sampled_a) Memory::instance()->sub(Memory::lua_memory, accounted_a);
+	}
+
+	size_t Lua::account()
+	{
+		size_t used = static_cast<size_t>(lua_gc(state_a, LUA_GCCOUNT, 0)) * 1024 + lua_gc(state_a, LUA_GCCOUNTB, 0);
+
+		if (!sampled_a) return used;
+		if (used > accounted_a) Memory::instance()->add(Memory::lua_memory, used - accounted_a);
+		else Memory::instance()->sub(Memory::lua_memory, accounted_a - used);
+		accounted_a = used;
+		return used;
+	}
+
+	const char * Lua::backend()
+	{
+#ifdef LUAJIT_VERSION
+		return LUAJIT_VERSION;
+#else
+		return LUA_RELEASE;
+#endif
+	}
+
+	bool Lua::call(const int ref_i, const int nres_i, const std::string & name_i)
+	{
+		lua_rawgeti(state_a, LUA_REGISTRYINDEX, ref_i);
+		return pcall(0, nres_i, name_i);
+	}
+
+	int Lua::compile(const std::string & code_i, const std::string & name_i)
+	{
+		if (luaL_loadbuffer(state_a, code_i.data(), code_i.size(), name_i.c_str()) != 0) {
+			error(name_i);
+			return LUA_NOREF;
+		}
+		return luaL_ref(state_a, LUA_REGISTRYINDEX);
+	}
+
+	void Lua::error(const std::string & name_i)
+	{
+		const char * msg = lua_tostring(state_a, -1);
+		LE("Lua error in %s: %s", name_i.c_str(), msg == nullptr ? "(no message)" : msg);
+		lua_pop(state_a, 1);
+	}
+
+	bool Lua::eval(const std::string & expr_i, const std::string & name_i, std::string & result_o)
+	{
+		std::string code = "return " + expr_i;
+
+		if (luaL_loadbuffer(state_a, code.data(), code.size(), name_i.c_str()) != 0 ||
+			lua_pcall(state_a, 0, 1, 0) != 0) {
+			error(name_i);
+			return false;
+		}
+
+		bool ok = tostring(-1, result_o, name_i);
+		lua_pop(state_a, 1);
+		return ok;
+	}
+
+	void Lua::function(const char * name_i, lua_CFunction fnc_i, void * ptr_i)
+	{
+		lua_getglobal(state_a, "clte");
+		lua_pushlightuserdata(state_a, ptr_i);
+		lua_pushcclosure(state_a, fnc_i, 1);
+		lua_setfield(state_a, -2, name_i);
+		lua_pop(state_a, 1);
+	}
+
+	bool Lua::pcall(const int nargs_i, const int nres_i, const std::string & name_i)
+	{
+		if (lua_pcall(state_a, nargs_i, nres_i, 0) != 0) {
+			error(name_i);
+			return false;
+		}
+		return true;
+	}
+
+	void Lua::release(const int ref_i)
+	{
+		luaL_unref(state_a, LUA_REGISTRYINDEX, ref_i);
+	}
+
+	bool Lua::run(const std::string & code_i, const std::string & name_i)
+	{
+		if (luaL_loadbuffer(state_a, code_i.data(), code_i.size(), name_i.c_str()) != 0 ||
+			lua_pcall(state_a, 0, 0, 0) != 0) {
+			error(name_i);
+			return false;
+		}
+		return true;
+	}
+
+	bool Lua::tostring(const int idx_i, std::string & str_o, const std::string & name_i)
+	{
+		size_t len = 0;
+		const char * str = nullptr;
+		int idx = lua_gettop(state_a) + idx_i + 1;
+
+		if (idx_i > 0) idx = idx_i;
+		switch (lua_type(state_a, idx)) {
+			case LUA_TSTRING:
+			case LUA_TNUMBER:
+				// Convert a copy, lua_tolstring changes numbers in place
+				lua_pushvalue(state_a, idx);
+				str = lua_tolstring(state_a, -1, &len);
+				str_o.assign(str, len);
+				lua_pop(state_a, 1);
+				return true;
+
+			default:
+				// __tostring metamethods can raise errors
+				lua_pushcfunction(state_a, &convert);
+				lua_pushvalue(state_a, idx);
+				if (lua_pcall(state_a, 1, 1, 0) != 0) {
+					error(name_i);
+					return false;
+				}
+				str = lua_tolstring(state_a, -1, &len);
+				str_o.assign(str == nullptr ? "" : str, len);
+				lua_pop(state_a, 1);
+				return true;
+		}
+	}
+
+} // Clte namespace
@@ -0,0 +1,157 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#pragma once
+
+#include <string>
+#include <lua.hpp>
+
+/** @{ Compatibility between the Lua 5.1 C API (also used by LuaJIT) and later
+ * versions. Only the subset the renderer needs is covered here. */
+#if LUA_VERSION_NUM < 502
+#define clte_pushglobals(L) lua_pushvalue(L, LUA_GLOBALSINDEX)
+#define clte_rawlen(L, i) lua_objlen(L, i)
+#else
+#define clte_pushglobals(L) lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_GLOBALS)
+#define clte_rawlen(L, i) lua_rawlen(L, i)
+#endif
+/** @} */
+
+namespace Clte
+{
+
+	/** Sandboxed Lua state used to evaluate template expressions. Works with
+	 * both the reference Lua implementation (5.1 up to 5.4) and LuaJIT,
+	 * which is selected at configure time with the LUA_BACKEND CMake
+	 * variable. Only the base, string, table and math libraries are
+	 * available, without the functions that access the file system, load
+	 * code, print or control the garbage collector. The string metatable
+	 * is hidden.
+	 * Functions provided by the renderer live in the global table clte.
+	 * Memory used by the state is accounted in Clte::Memory. */
+	class Lua
+	{
+		protected:
+		// Lua state
+		lua_State * state_a;
+
+		// True when memory use is sampled instead of tracked per allocation
+		bool sampled_a;
+
+		// Bytes accounted when sampling
+		size_t accounted_a;
+
+		// Log the error message on top of the stack and pop it
+		void error(const std::string & name_i);
+
+		public:
+		// Default constructor, creates the sandboxed state
+		Lua();
+
+		// Copying would duplicate ownership of the state
+		Lua(const Lua & obj_i) = delete;
+		Lua & operator=(const Lua & obj_i) = delete;
+
+		// Default destructor
+		~Lua();
+
+		/** Update the accounted memory use. Allocations are normally tracked
+		 * as they happen, but 64-bit LuaJIT doesn't support custom
+		 * allocators, so its use is sampled here instead.
+		 * @returns Number of bytes in use by the state. */
+		size_t account();
+
+		/** Get the name and version of the Lua implementation.
+		 * @returns E.g. "Lua 5.3.6" or "LuaJIT 2.1.0-beta3". */
+		static const char * backend();
+
+		/** Call a compiled chunk.
+		 * @param ref_i Reference returned by compile().
+		 * @param nres_i Number of results to leave on the stack.
+		 * @param name_i Name of the chunk for error messages.
+		 * @returns True if successful, false if not. */
+		bool call(const int ref_i, const int nres_i, const std::string & name_i);
+
+		/** Compile a chunk once for repeated calls. With LuaJIT, hot loops
+		 * inside such chunks are JIT-compiled.
+		 * @param code_i Lua source code.
+		 * @param name_i Name of the chunk for error messages.
+		 * @returns Registry reference to the compiled chunk, LUA_NOREF
+		 * when compilation failed. */
+		int compile(const std::string & code_i, const std::string & name_i);
+
+		/** Evaluate an expression and convert the result to a string.
+		 * @param expr_i Lua expression.
+		 * @param name_i Name of the expression for error messages.
+		 * @param result_o String to store the result in.
+		 * @returns True if successful, false if not. */
+		bool eval(const std::string & expr_i, const std::string & name_i, std::string & result_o);
+
+		/** Register a C function in the global clte table.
+		 * @param name_i Name of the function.
+		 * @param fnc_i C function to register.
+		 * @param ptr_i Pointer available to the function as first upvalue. */
+		void function(const char * name_i, lua_CFunction fnc_i, void * ptr_i);
+
+		/** Call the function below its arguments on the stack in protected
+		 * mode.
+		 * @param nargs_i Number of arguments on the stack.
+		 * @param nres_i Number of results to leave on the stack.
+		 * @param name_i Name of the function for error messages.
+		 * @returns True if successful, false if not. */
+		bool pcall(const int nargs_i, const int nres_i, const std::string & name_i);
+
+		/** Release a compiled chunk.
+		 * @param ref_i Reference returned by compile(). */
+		void release(const int ref_i);
+
+		/** Execute a chunk of Lua code.
+		 * @param code_i Lua source code.
+		 * @param name_i Name of the chunk for error messages.
+		 * @returns True if successful, false if not. */
+		bool run(const std::string & code_i, const std::string & name_i);
+
+		/** Get the underlying Lua state.
+		 * @returns Pointer to the Lua state. */
+		inline lua_State * state() const { return state_a; }
+
+		/** Convert the value at a stack index to a string, like Lua's own
+		 * tostring() does, in a protected call.
+		 * @param idx_i Stack index.
+		 * @param str_o String to store the result in.
+		 * @param name_i Name of the chunk for error messages.
+		 * @returns True if successful, false if a __tostring metamethod
+		 * failed. */
+		bool tostring(const int idx_i, std::string & str_o, const std::string & name_i);
+	};
+
+} // Clte namespace
@@ -0,0 +1,204 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include "Logger.h"
+#include "Memo.h"
+#include "Stats.h"
+
+namespace Clte
+{
+
+	Memo::Memo(Lua & lua_i, const size_t capacity_i)
+	: lua_a(lua_i), capacity_a(capacity_i), values_a(LUA_NOREF), nextid_a(1), hits_a(0), misses_a(0), bypassed_a(0)
+	{
+		LCET(capacity_i > 0, std::invalid_argument, "Memoisation cache capacity must be positive");
+		lua_newtable(lua_a.state());
+		values_a = luaL_ref(lua_a.state(), LUA_REGISTRYINDEX);
+		lua_a.function("pure", &Memo::pure, this);
+	}
+
+	Memo::~Memo()
+	{
+		lua_a.release(values_a);
+	}
+
+	int Memo::call(lua_State * L)
+	{
+		Memo * memo = static_cast<Memo *>(lua_touserdata(L, lua_upvalueindex(1)));
+
+		// No C++ objects may be alive when lua_error() jumps out
+		int nres = memo->invoke(L);
+		if (nres < 0) return lua_error(L);
+		return nres;
+	}
+
+	void Memo::clear()
+	{
+		lua_State * L = lua_a.state();
+
+		lru_a.clear();
+		index_a.clear();
+		lua_a.release(values_a);
+		lua_newtable(L);
+		values_a = luaL_ref(L, LUA_REGISTRYINDEX);
+	}
+
+	int Memo::invoke(lua_State * L)
+	{
+		int nargs = lua_gettop(L);
+		std::string id;
+
+		if (!lua_checkstack(L, nargs + 3)) {
+			lua_pushliteral(L, "too many arguments");
+			return -1;
+		}
+		if (!key(L, nargs, id)) {
+			bypassed_a++;
+			lua_pushvalue(L, lua_upvalueindex(2));
+			lua_insert(L, 1);
+			if (lua_pcall(L, nargs, LUA_MULTRET, 0) != 0) return -1;
+			return lua_gettop(L);
+		}
+
+		auto it = index_a.find(id);
+		if (it != index_a.end()) {
+			hits_a++;
+			Stats::add(Stats::cache_hits, 1);
+			lru_a.splice(lru_a.begin(), lru_a, it->second);
+			lua_rawgeti(L, LUA_REGISTRYINDEX, values_a);
+			lua_rawgeti(L, -1, it->second->second);
+			lua_getfield(L, -1, "n");
+			int nres = lua_tointeger(L, -1);
+			lua_pop(L, 1);
+			if (!lua_checkstack(L, nres)) {
+				lua_pushliteral(L, "too many results");
+				return -1;
+			}
+			for (int i = 1; i <= nres; i++) lua_rawgeti(L, nargs + 2, i);
+			return nres;
+		}
+
+		misses_a++;
+		Stats::add(Stats::cache_misses, 1);
+		lua_pushvalue(L, lua_upvalueindex(2));
+		for (int i = 1; i <= nargs; i++) lua_pushvalue(L, i);
+		if (lua_pcall(L, nargs, LUA_MULTRET, 0) != 0) return -1;
+		int nres = lua_gettop(L) - nargs;
+
+		// Reuse the slot of the least recently used entry when full
+		int slot = lru_a.size() + 1;
+		if (lru_a.size() >= capacity_a) {
+			slot = lru_a.back().second;
+			index_a.erase(lru_a.back().first);
+			lru_a.pop_back();
+		}
+		lru_a.emplace_front(id, slot);
+		index_a.emplace(std::move(id), lru_a.begin());
+
+		lua_rawgeti(L, LUA_REGISTRYINDEX, values_a);
+		lua_createtable(L, nres, 1);
+		for (int i = 1; i <= nres; i++) {
+			lua_pushvalue(L, nargs + i);
+			lua_rawseti(L, -2, i);
+		}
+		lua_pushinteger(L, nres);
+		lua_setfield(L, -2, "n");
+		lua_rawseti(L, -2, slot);
+		lua_pop(L, 1);
+		return nres;
+	}
+
+	bool Memo::key(lua_State * L, const int nargs_i, std::string & key_o) const
+	{
+		lua_Integer id = lua_tointeger(L, lua_upvalueindex(3));
+		lua_Number num = 0;
+		const char * str = nullptr;
+		size_t len = 0;
+
+		key_o.assign(reinterpret_cast<const char *>(&id), sizeof(id));
+		for (int i = 1; i <= nargs_i; i++) {
+			switch (lua_type(L, i)) {
+				case LUA_TNIL:
+					key_o.push_back('n');
+					break;
+
+				case LUA_TBOOLEAN:
+					key_o.push_back(lua_toboolean(L, i) ? 't' : 'f');
+					break;
+
+				case LUA_TNUMBER:
+#if LUA_VERSION_NUM >= 503
+					// Integers are exact beyond 2^53 and 1 differs from 1.0
+					if (lua_isinteger(L, i)) {
+						lua_Integer val = lua_tointeger(L, i);
+						key_o.push_back('i');
+						key_o.append(reinterpret_cast<const char *>(&val), sizeof(val));
+						break;
+					}
+#endif
+					num = lua_tonumber(L, i);
+					key_o.push_back('d');
+					key_o.append(reinterpret_cast<const char *>(&num), sizeof(num));
+					break;
+
+				case LUA_TSTRING:
+					str = lua_tolstring(L, i, &len);
+					key_o.push_back('s');
+					key_o.append(reinterpret_cast<const char *>(&len), sizeof(len));
+					key_o.append(str, len);
+					break;
+
+				default:
+					return false;
+			}
+		}
+
+		return true;
+	}
+
+	int Memo::pure(lua_State * L)
+	{
+		Memo * memo = static_cast<Memo *>(lua_touserdata(L, lua_upvalueindex(1)));
+
+		luaL_checktype(L, 1, LUA_TFUNCTION);
+		lua_settop(L, 1);
+		lua_pushlightuserdata(L, memo);
+		lua_insert(L, 1);
+		lua_pushinteger(L, memo->nextid_a++);
+		lua_pushcclosure(L, &Memo::call, 3);
+		return 1;
+	}
+
+} // Clte namespace
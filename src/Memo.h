@@ -0,0 +1,131 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include "Lua.h"
+
+namespace Clte
+{
+
+	/** Memoisation of pure Lua functions. Templates wrap a function with
+	 * clte.pure(fn), after which calls with the same argument values return
+	 * the cached results instead of calling the function again. Results
+	 * of all wrapped functions share one bounded cache, evicting the least
+	 * recently used entries when full. Calls with arguments other than
+	 * nil, booleans, numbers and strings are passed through uncached. */
+	class Memo
+	{
+		protected:
+		/// Cache entries in LRU order, most recently used first
+		typedef std::list<std::pair<std::string, int> > lru_t;
+
+		// Lua state the cache lives in
+		Lua & lua_a;
+
+		// Maximum number of cached results
+		size_t capacity_a;
+
+		// Cache entries, key and slot in the values table
+		lru_t lru_a;
+
+		// Maps keys to cache entries
+		std::unordered_map<std::string, lru_t::iterator> index_a;
+
+		// Registry reference to the table with packed results per slot
+		int values_a;
+
+		// Identifier of the next wrapped function
+		lua_Integer nextid_a;
+
+		// Number of calls served from the cache
+		uint64_t hits_a;
+
+		// Number of calls that had to call the function
+		uint64_t misses_a;
+
+		// Number of calls with arguments that can't be cached
+		uint64_t bypassed_a;
+
+		// Lua: wrapper calling the function through the cache
+		static int call(lua_State * L);
+
+		// Lua: clte.pure(fn), wrap a function
+		static int pure(lua_State * L);
+
+		// Handle a call of a wrapped function, returns the number of results
+		// or -1 with the error message on top of the stack
+		int invoke(lua_State * L);
+
+		// Build the cache key from the function id and arguments
+		bool key(lua_State * L, const int nargs_i, std::string & key_o) const;
+
+		public:
+		/** Constructor, registers clte.pure in the Lua state.
+		 * @param lua_i Lua state to use.
+		 * @param capacity_i Maximum number of cached results, default 4096. */
+		Memo(Lua & lua_i, const size_t capacity_i = 4096);
+
+		// Copying would duplicate the cache
+		Memo(const Memo & obj_i) = delete;
+		Memo & operator=(const Memo & obj_i) = delete;
+
+		// Default destructor, releases the cached results
+		~Memo();
+
+		/** Get the number of calls with uncacheable arguments.
+		 * @returns Number of bypassed calls. */
+		inline uint64_t bypassed() const { return bypassed_a; }
+
+		/** Drop all cached results, e.g. when the template that wrapped
+		 * the functions is compiled again. */
+		void clear();
+
+		/** Get the number of cache hits.
+		 * @returns Number of calls served from the cache. */
+		inline uint64_t hits() const { return hits_a; }
+
+		/** Get the number of cache misses.
+		 * @returns Number of calls that called the wrapped function. */
+		inline uint64_t misses() const { return misses_a; }
+
+		/** Get the number of cached results.
+		 * @returns Number of entries in the cache. */
+		inline size_t size() const { return lru_a.size(); }
+	};
+
+} // Clte namespace
@@ -0,0 +1,134 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include "Logger.h"
+#include "Memory.h"
+
+namespace Clte
+{
+
+	Memory::Memory()
+	: total_a(0), totalpeak_a(0), limit_a(0), jobs_a(0), reserved_a(0)
+	{
+		for (int i = 0; i < categories; i++) {
+			used_a[i] = 0;
+			peak_a[i] = 0;
+		}
+	}
+
+	Memory::~Memory()
+	{ }
+
+	Memory::Admission::Admission(const size_t size_i)
+	: size_a(size_i)
+	{
+		Memory::instance()->admit(size_a);
+	}
+
+	Memory::Admission::~Admission()
+	{
+		Memory::instance()->release(size_a);
+	}
+
+	void Memory::add(const category_t cat_i, const size_t size_i)
+	{
+		raise(peak_a[cat_i], used_a[cat_i].fetch_add(size_i, std::memory_order_relaxed) + size_i);
+		raise(totalpeak_a, total_a.fetch_add(size_i, std::memory_order_relaxed) + size_i);
+	}
+
+	void Memory::admit(const size_t size_i)
+	{
+		std::unique_lock<std::mutex> lck(mux_a);
+
+		// Only other running jobs count, the memory of the caller itself
+		// is only released after it is admitted
+		cv_a.wait(lck, [this, size_i]() {
+			size_t lim = limit_a;
+			return lim == 0 || jobs_a == 0 || reserved_a + size_i <= lim;
+		});
+		jobs_a++;
+		reserved_a += size_i;
+	}
+
+	void Memory::limit(const size_t limit_i)
+	{
+		{
+			GRD(mux_a);
+			limit_a = limit_i;
+		}
+		cv_a.notify_all();
+	}
+
+	const char * Memory::name(const category_t cat_i)
+	{
+		switch (cat_i) {
+			case data_memory: return "data";
+			case template_memory: return "templates";
+			case lua_memory: return "Lua";
+			case output_memory: return "output buffers";
+			default: return "unknown";
+		}
+	}
+
+	void Memory::raise(std::atomic<size_t> & peak_i, const size_t value_i)
+	{
+		size_t cur = peak_i.load(std::memory_order_relaxed);
+		while (cur < value_i && !peak_i.compare_exchange_weak(cur, value_i, std::memory_order_relaxed)) { }
+	}
+
+	void Memory::release(const size_t size_i)
+	{
+		{
+			GRD(mux_a);
+			jobs_a--;
+			reserved_a -= size_i;
+		}
+		cv_a.notify_all();
+	}
+
+	void Memory::report() const
+	{
+		for (int i = 0; i < categories; i++) {
+			category_t cat = static_cast<category_t>(i);
+			LI("Memory high-water mark of %s: %zu bytes", name(cat), peak(cat));
+		}
+		size_t lim = limit_a;
+		LI("Memory high-water mark in total: %zu bytes%s", peak(), lim > 0 && peak() > lim ? ", over the limit" : "");
+	}
+
+	void Memory::sub(const category_t cat_i, const size_t size_i)
+	{
+		used_a[cat_i].fetch_sub(size_i, std::memory_order_relaxed);
+		total_a.fetch_sub(size_i, std::memory_order_relaxed);
+	}
+
+} // Clte namespace
@@ -0,0 +1,198 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include "Singleton.h"
+
+namespace Clte
+{
+
+	/** Global memory accounting. Data documents, compiled templates, Lua
+	 * states and output buffers report what they allocate and release, so
+	 * the current use and high-water marks are known per category. With a
+	 * limit set, new renders wait in admit() until their estimate fits next
+	 * to the renders still running, and output buffers are flushed early
+	 * instead of queued. */
+	class Memory : public Fs2a::Singleton<Memory>
+	{
+		// Singleton template as friend for construction
+		friend class Fs2a::Singleton<Memory>;
+
+		public:
+		/// Accounted categories
+		enum category_t : uint8_t {
+			data_memory = 0,     ///< Data documents
+			template_memory = 1, ///< Compiled templates
+			lua_memory = 2,      ///< Lua states
+			output_memory = 3,   ///< Output buffers
+			categories = 4       ///< Number of categories
+		};
+
+		/** Reservation of a job admitted under the limit, released when it
+		 * goes out of scope. */
+		class Admission
+		{
+			protected:
+			// Reserved number of bytes
+			size_t size_a;
+
+			public:
+			/** Constructor, waits in admit() until the job fits.
+			 * @param size_i Estimated number of bytes the job will use. */
+			Admission(const size_t size_i);
+
+			// Copy constructor
+			Admission(const Admission & obj_i) = delete;
+
+			// Assignment constructor
+			Admission & operator=(const Admission & obj_i) = delete;
+
+			// Destructor, releases the reservation
+			~Admission();
+		};
+
+		private:
+		// Default constructor
+		Memory();
+
+		// Copy constructor
+		Memory(const Memory & obj_i) = delete;
+
+		// Assignment constructor
+		Memory & operator=(const Memory & obj_i) = delete;
+
+		// Destructor
+		~Memory();
+
+		protected:
+		// Bytes in use per category
+		std::atomic<size_t> used_a[categories];
+
+		// High-water mark per category
+		std::atomic<size_t> peak_a[categories];
+
+		// Bytes in use in total
+		std::atomic<size_t> total_a;
+
+		// High-water mark of the total
+		std::atomic<size_t> totalpeak_a;
+
+		// Limit of the total, 0 for no limit
+		std::atomic<size_t> limit_a;
+
+		// Number of admitted jobs still running, protected by mux_a
+		size_t jobs_a;
+
+		// Bytes reserved by admitted jobs, protected by mux_a
+		size_t reserved_a;
+
+		// Protects waiting for memory to be released
+		std::mutex mux_a;
+
+		// Signals memory being released
+		std::condition_variable cv_a;
+
+		// Raise a high-water mark to at least a value
+		static void raise(std::atomic<size_t> & peak_i, const size_t value_i);
+
+		public:
+		/** Account for allocated memory.
+		 * @param cat_i Category to account to.
+		 * @param size_i Number of bytes allocated. */
+		void add(const category_t cat_i, const size_t size_i);
+
+		/** Wait until a job of an estimated size fits within the limit next
+		 * to the other admitted jobs. Memory the caller already holds does
+		 * not count against it, and a job is always admitted when no other
+		 * job runs, so a single job larger than the limit still runs. Use
+		 * an Admission to release the reservation again.
+		 * @param size_i Estimated number of bytes the job will use. */
+		void admit(const size_t size_i);
+
+		/** Check whether the total is over the limit.
+		 * @returns True if a limit is set and exceeded. */
+		inline bool exceeded() const
+		{
+			size_t lim = limit_a.load(std::memory_order_relaxed);
+			return lim > 0 && total_a.load(std::memory_order_relaxed) > lim;
+		}
+
+		/** Get the limit.
+		 * @returns Limit in bytes, 0 for no limit. */
+		inline size_t limit() const { return limit_a; }
+
+		/** Set the limit.
+		 * @param limit_i Limit in bytes, 0 for no limit. */
+		void limit(const size_t limit_i);
+
+		/** Release the reservation of an admitted job.
+		 * @param size_i Number of bytes passed to admit(). */
+		void release(const size_t size_i);
+
+		/** Get the name of a category.
+		 * @param cat_i Category.
+		 * @returns Name for log messages. */
+		static const char * name(const category_t cat_i);
+
+		/** Get the high-water mark of a category.
+		 * @param cat_i Category.
+		 * @returns Highest number of bytes in use so far. */
+		inline size_t peak(const category_t cat_i) const { return peak_a[cat_i]; }
+
+		/** Get the high-water mark of the total.
+		 * @returns Highest number of bytes in use so far. */
+		inline size_t peak() const { return totalpeak_a; }
+
+		/** Log the high-water marks. */
+		void report() const;
+
+		/** Account for released memory.
+		 * @param cat_i Category to account to.
+		 * @param size_i Number of bytes released. */
+		void sub(const category_t cat_i, const size_t size_i);
+
+		/** Get the number of bytes in use in a category.
+		 * @param cat_i Category.
+		 * @returns Bytes in use. */
+		inline size_t used(const category_t cat_i) const { return used_a[cat_i]; }
+
+		/** Get the number of bytes in use in total.
+		 * @returns Bytes in use. */
+		inline size_t used() const { return total_a; }
+	};
+
+} // Clte namespace
@@ -0,0 +1,157 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <unistd.h>
+#include "Logger.h"
+#include "Native.h"
+#include "Stats.h"
+
+namespace Clte
+{
+
+	Native::Native(const std::string & name_i, const Chunk * chunks_i, block_t root_i)
+	: chunks_a(chunks_i), root_a(root_i)
+	{
+		LCET(chunks_i != nullptr && root_i != nullptr, std::invalid_argument, "Compiled template %s is incomplete", name_i.c_str());
+		tplname_a = name_i;
+
+		size_t count = 0;
+		while (chunks_a[count].code != nullptr) count++;
+		refs_a.assign(count, LUA_NOREF);
+	}
+
+	Native::~Native()
+	{
+		for (int ref : refs_a) lua_a.release(ref);
+	}
+
+	bool Native::exec(const size_t idx_i)
+	{
+		int ref = this->ref(idx_i);
+		return ref != LUA_NOREF && lua_a.call(ref, 0, tplname_a);
+	}
+
+	bool Native::iterate(const size_t idx_i, const bool data_i, block_t body_i)
+	{
+		bool streamed = data_i && stream_a && frames_a.empty();
+		int ref = streamed ? LUA_NOREF : this->ref(idx_i);
+
+		if (!streamed && ref == LUA_NOREF) return false;
+		return loop(ref, chunks_a[idx_i].line, [this, body_i]() { return body_i(*this); });
+	}
+
+	int Native::main(const int argc_i, char * argv_i[])
+	{
+		std::string dir, outfile;
+		bool stream = false;
+		int opt = 0, res = 0;
+
+		Fs2a::Logger::instance()->stderror();
+		while ((opt = getopt(argc_i, argv_i, "d:i:o:pS")) != -1) {
+			switch (opt) {
+				case 'd': dir = optarg; break;
+				case 'i': if (!index(optarg)) return 1; break;
+				case 'o': outfile = optarg; break;
+				case 'p': pipelined(true); break;
+				case 'S': stream = true; break;
+				default: optind = argc_i + 1; break;
+			}
+		}
+		if (optind + 1 != argc_i) {
+			std::cerr << "Usage: " << argv_i[0] << " [-d <dir>] [-i <path:field>] [-o <outfile>] [-p] [-S] <datafile>" << std::endl;
+			std::cerr << "Renders the template " << tplname_a << ", compiled into this program." << std::endl;
+			return 1;
+		}
+
+		try {
+			std::ofstream ofs;
+			if (!outfile.empty()) {
+				ofs.open(outfile, std::ios::binary | std::ios::trunc);
+				LCET(ofs.good(), std::runtime_error, "Unable to open output file %s", outfile.c_str());
+			}
+			if (!data(argv_i[optind], stream)) throw 1;
+			if (!dir.empty() && !outdir(dir)) throw 1;
+			out(outfile.empty() ? &std::cout : &ofs);
+			render();
+		} catch (const std::exception & se) {
+			LE("Caught general exception: %s", se.what());
+			res = 1;
+		} catch (const int & i) {
+			res = i;
+		}
+
+		return res;
+	}
+
+	bool Native::output(const size_t idx_i)
+	{
+		std::string str;
+		int ref = this->ref(idx_i);
+
+		if (ref == LUA_NOREF || !lua_a.call(ref, 1, tplname_a)) return false;
+		bool ok = lua_a.tostring(-1, str, tplname_a);
+		lua_pop(lua_a.state(), 1);
+		if (!ok) return false;
+		emitter_a->write(str);
+		return true;
+	}
+
+	int Native::ref(const size_t idx_i)
+	{
+		if (refs_a[idx_i] != LUA_NOREF) return refs_a[idx_i];
+
+		Stats::Timer tmr(Stats::compile_time);
+		refs_a[idx_i] = lua_a.compile(chunks_a[idx_i].code, "=" + tplname_a + ":" + std::to_string(chunks_a[idx_i].line));
+		return refs_a[idx_i];
+	}
+
+	void Native::render()
+	{
+		LCET(out_a != nullptr, std::logic_error, "Output stream pointer wasn't set, call out() first.");
+
+		generate([]() { return true; }, [this](Emitter &) { return root_a(*this); });
+	}
+
+	bool Native::test(const size_t idx_i, bool & cond_o)
+	{
+		int ref = this->ref(idx_i);
+
+		if (ref == LUA_NOREF || !lua_a.call(ref, 1, tplname_a)) return false;
+		cond_o = lua_toboolean(lua_a.state(), -1);
+		lua_pop(lua_a.state(), 1);
+		return true;
+	}
+
+} // Clte namespace
@@ -0,0 +1,142 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Emit.h"
+#include "Renderer.h"
+
+namespace Clte
+{
+
+	/** Renderer for templates translated into C++ by clite --emit-cpp. The
+	 * generated code contains literal text as constant arrays and control
+	 * flow as native C++, calling into this class for the Lua expressions,
+	 * which are compiled on first use, and for iterations over data. There
+	 * is no template to scan or parse at run time. */
+	class Native : public Renderer
+	{
+		public:
+		/// Generated function executing a list of template nodes
+		typedef bool (*block_t)(Native & rnd_i);
+
+		/// Lua code of a template node
+		struct Chunk {
+			const char * code; ///< Lua code, expressions start with "return"
+			uint32_t line;     ///< Template line, for error messages
+		};
+
+		protected:
+		// Lua code of the template, terminated by a NULL code
+		const Chunk * chunks_a;
+
+		// Registry references to the compiled chunks, LUA_NOREF if not yet
+		std::vector<int> refs_a;
+
+		// Block of the whole template
+		block_t root_a;
+
+		/** Get a compiled chunk, compiling it on first use.
+		 * @param idx_i Index in chunks_a.
+		 * @returns Registry reference to the chunk, LUA_NOREF on errors. */
+		int ref(const size_t idx_i);
+
+		public:
+		/** Constructor.
+		 * @param name_i Name of the template, used in error messages.
+		 * @param chunks_i Lua code of the template, terminated by an entry
+		 * with NULL code. Must stay valid.
+		 * @param root_i Block of the whole template. */
+		Native(const std::string & name_i, const Chunk * chunks_i, block_t root_i);
+
+		// Destructor, releases the compiled chunks
+		~Native();
+
+		/** Get the emitter of the render in progress, for literal text.
+		 * @returns Reference to the emitter. */
+		inline Emitter & emitter() { return *emitter_a; }
+
+		/** Execute a @! block.
+		 * @param idx_i Chunk index.
+		 * @returns True if successful, false if not. */
+		bool exec(const size_t idx_i);
+
+		/** Execute a @$ iteration.
+		 * @param idx_i Chunk index of the collection.
+		 * @param data_i True if the collection is plain "data", which
+		 * iterates over the streamed elements in streaming mode.
+		 * @param body_i Block executed for every element.
+		 * @returns True if successful, false if not. */
+		bool iterate(const size_t idx_i, const bool data_i, block_t body_i);
+
+		/** Run as the main function of a generator binary. Usage is
+		 * "[-d <dir>] [-i <path:field>] [-o <outfile>] [-p] [-S] <datafile>",
+		 * with the same meaning as for clite.
+		 * @param argc_i Number of arguments.
+		 * @param argv_i Arguments.
+		 * @returns Exit code. */
+		int main(const int argc_i, char * argv_i[]);
+
+
+		/** Execute a @= expression and write the result.
+		 * @param idx_i Chunk index.
+		 * @returns True if successful, false if not. */
+		bool output(const size_t idx_i);
+
+		/** Render the compiled template to the output. Input streams are
+		 * not used.
+		 * @throws std::logic_error when the output stream is not set
+		 * @throws std::runtime_error when loading data or writing output
+		 * fails */
+		void render() override;
+
+		/** Evaluate the condition of a @? block.
+		 * @param idx_i Chunk index.
+		 * @param cond_o Set to the truth value of the condition.
+		 * @returns True if successful, false if not. */
+		bool test(const size_t idx_i, bool & cond_o);
+
+		/** Write the key or value of an iteration, @^ or @+.
+		 * @param depth_i Depth of the iteration, 1 for the innermost.
+		 * @param value_i True for the value, false for the key.
+		 * @param line_i Template line, for error messages.
+		 * @returns True if successful, false if not. */
+		inline bool write(const size_t depth_i, const bool value_i, const uint32_t line_i)
+		{
+			return Renderer::write(depth_i, value_i, line_i, *emitter_a);
+		}
+	};
+
+} // Clte namespace
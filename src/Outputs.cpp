@@ -0,0 +1,169 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <sys/stat.h>
+#include "Logger.h"
+#include "Outputs.h"
+#include "Stats.h"
+
+namespace Clte
+{
+
+	Outputs::Outputs(const std::string & dir_i, const size_t bufsize_i, const size_t depth_i, const size_t threads_i)
+	: QueueBuf(bufsize_i, depth_i), dir_a(dir_i), sel_a(none), done_a(false)
+	{
+		if (!dir_a.empty() && dir_a.back() != '/') dir_a += '/';
+		discard_a = true;
+		io_a = IoWriter::create(threads_i);
+		LD("Writing output files to %s using %s", dir_a.c_str(), io_a->name());
+		thread_a = std::thread(&Outputs::writer, this);
+	}
+
+	Outputs::~Outputs()
+	{
+		close();
+	}
+
+	bool Outputs::close()
+	{
+		if (thread_a.joinable()) {
+			deselect();
+			{
+				GRD(mux_a);
+				done_a = true;
+			}
+			cv_a.notify_all();
+			thread_a.join();
+			LD("Wrote %zu output files to %s", files_a.size(), dir_a.c_str());
+		}
+
+		GRD(mux_a);
+		return !failed_a;
+	}
+
+	void Outputs::deselect()
+	{
+		if (sel_a != none) queue(true);
+		sel_a = none;
+		discard_a = true;
+	}
+
+	void Outputs::directories(const std::string & name_i)
+	{
+		size_t slash = name_i.rfind('/');
+		if (slash == std::string::npos || dirs_a.count(name_i.substr(0, slash)) > 0) return;
+
+		// Parents first, remembering every level so siblings are cheap
+		for (size_t pos = name_i.find('/'); pos != std::string::npos && pos <= slash; pos = name_i.find('/', pos + 1)) {
+			std::string sub = name_i.substr(0, pos);
+			if (sub.empty() || sub.back() == '/' || dirs_a.count(sub) > 0) continue;
+
+			std::string path = dir_a + sub;
+			LCET(mkdir(path.c_str(), 0777) == 0 || errno == EEXIST, std::runtime_error,
+				"Unable to create output directory %s: %s", path.c_str(), strerror(errno));
+			dirs_a.insert(sub);
+		}
+	}
+
+	void Outputs::handoff()
+	{
+		queue(false);
+	}
+
+	void Outputs::queue(const bool close_i, const bool force_i)
+	{
+		if (cur_a.empty() && !close_i && !force_i) return;
+
+		std::unique_lock<std::mutex> lck(mux_a);
+		cv_a.wait(lck, [this]() { return queue_a.size() < limit(); });
+		queue_a.push_back(Job{ &files_a[sel_a], close_i, std::move(cur_a) });
+		renew();
+		lck.unlock();
+		cv_a.notify_all();
+	}
+
+	void Outputs::select(const std::string & name_i)
+	{
+		LCET(!name_i.empty() && name_i[0] != '/', std::invalid_argument, "Invalid output file name '%s'", name_i.c_str());
+		LCET(name_i != ".." && name_i.compare(0, 3, "../") != 0 && name_i.find("/../") == std::string::npos &&
+			(name_i.size() < 3 || name_i.compare(name_i.size() - 3, 3, "/..") != 0),
+			std::invalid_argument, "Output file name '%s' may not leave the output directory", name_i.c_str());
+
+		auto it = index_a.find(name_i);
+		size_t idx = it == index_a.end() ? files_a.size() : it->second;
+		if (idx == sel_a) return;
+
+		deselect();
+		if (it == index_a.end()) {
+			directories(name_i);
+			GRD(mux_a);
+			files_a.push_back(File{ dir_a + name_i, idx, -1, -1, false, 0 });
+			index_a.emplace(name_i, idx);
+		}
+		sel_a = idx;
+		discard_a = false;
+
+		// Create the file even if nothing is written to it
+		queue(false, true);
+	}
+
+	void Outputs::writer()
+	{
+		std::vector<Job> batch;
+		std::unique_lock<std::mutex> lck(mux_a);
+
+		for (;;) {
+			cv_a.wait(lck, [this]() { return done_a || !queue_a.empty(); });
+			if (queue_a.empty()) break;
+
+			batch.clear();
+			for (Job & job : queue_a) batch.push_back(std::move(job));
+			queue_a.clear();
+			lck.unlock();
+			cv_a.notify_all();
+
+			bool good = false;
+			{
+				Stats::Timer tmr(Stats::write_time);
+				good = io_a->write(batch);
+			}
+
+			lck.lock();
+			if (!good) failed_a = true;
+			for (Job & job : batch) recycle(std::move(job.data));
+		}
+	}
+
+} // Clte namespace
@@ -0,0 +1,141 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "IoWriter.h"
+#include "QueueBuf.h"
+
+namespace Clte
+{
+
+	/** Set of output files in one directory, written by a background I/O
+	 * thread. Output goes to the currently selected file. Selecting another
+	 * file hands the collected output of the current one to the I/O thread,
+	 * which opens, writes and closes the files while rendering continues.
+	 * The I/O thread takes all queued jobs at once and passes them to an
+	 * IoWriter, so many small files are written in parallel.
+	 * Files are only kept open while selected, so any number of them can be
+	 * written. Selecting a file again appends to it. Subdirectories are
+	 * created as needed. */
+	class Outputs : public QueueBuf
+	{
+		protected:
+		typedef IoWriter::Job Job;
+		typedef IoWriter::File File;
+
+		// Directory to create the files in
+		std::string dir_a;
+
+		/// Index of no file
+		static constexpr size_t none = ~static_cast<size_t>(0);
+
+		// Index of the selected file, none if no file is selected
+		size_t sel_a;
+
+		// Files by index, only appended to, used by the I/O thread after creation
+		std::deque<File> files_a;
+
+		// File indices by name
+		std::unordered_map<std::string, size_t> index_a;
+
+		// Subdirectories of dir_a known to exist
+		std::unordered_set<std::string> dirs_a;
+
+		// Jobs waiting for the I/O thread, protected by mux_a like
+		// files_a and done_a
+		std::deque<Job> queue_a;
+
+		// Backend executing the jobs
+		std::unique_ptr<IoWriter> io_a;
+
+		// I/O thread
+		std::thread thread_a;
+
+		// Set when no more jobs will be queued
+		bool done_a;
+
+		// Create the missing directories leading to a file
+		void directories(const std::string & name_i);
+
+		// Queue the collected output of the selected file
+		void handoff() override;
+
+		// Queue the collected output of the selected file, if any or forced
+		void queue(const bool close_i, const bool force_i = false);
+
+		// I/O thread main loop
+		void writer();
+
+		public:
+		/** Constructor, starts the I/O thread.
+		 * @param dir_i Directory to create the files in, must exist.
+		 * @param bufsize_i Size of a single buffer, default 64 KiB.
+		 * @param depth_i Maximum number of queued jobs, default 64.
+		 * @param threads_i Number of threads when the I/O backend is a
+		 * thread pool, default 4.
+		 * @throws std::invalid_argument when @p bufsize_i or @p depth_i
+		 * is 0. */
+		Outputs(const std::string & dir_i, const size_t bufsize_i = 64 * 1024, const size_t depth_i = 64, const size_t threads_i = 4);
+
+		// Destructor, closes if not closed yet
+		~Outputs();
+
+		/** Write all pending output, close all files and stop the I/O
+		 * thread.
+		 * @returns True if all files were written successfully. */
+		bool close();
+
+		/** Stop writing to the selected file. Output written to this
+		 * stream buffer afterwards is discarded until the next select(). */
+		void deselect();
+
+		/** Get the number of files selected so far.
+		 * @returns Number of files. */
+		inline size_t files() const { return files_a.size(); }
+
+		/** Select the file to write following output to.
+		 * @param name_i Name of the file, relative to the directory.
+		 * @throws std::invalid_argument when @p name_i is empty, absolute
+		 * or contains ".." components.
+		 * @throws std::runtime_error when creating a subdirectory fails */
+		void select(const std::string & name_i);
+	};
+
+} // Clte namespace
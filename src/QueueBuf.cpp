@@ -0,0 +1,113 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <algorithm>
+#include <stdexcept>
+#include "Logger.h"
+#include "Memory.h"
+#include "QueueBuf.h"
+
+namespace Clte
+{
+
+	QueueBuf::QueueBuf(const size_t bufsize_i, const size_t depth_i)
+	: bufsize_a(bufsize_i), depth_a(depth_i), buffers_a(1), discard_a(false), failed_a(false)
+	{
+		LCET(bufsize_i > 0 && depth_i > 0, std::invalid_argument, "Buffer size and queue depth must be positive");
+		cur_a.reserve(bufsize_a);
+		Memory::instance()->add(Memory::output_memory, bufsize_a);
+	}
+
+	QueueBuf::~QueueBuf()
+	{
+		Memory::instance()->sub(Memory::output_memory, buffers_a * bufsize_a);
+	}
+
+	size_t QueueBuf::limit() const
+	{
+		return Memory::instance()->exceeded() ? 1 : depth_a;
+	}
+
+	QueueBuf::int_type QueueBuf::overflow(int_type ch_i)
+	{
+		if (traits_type::eq_int_type(ch_i, traits_type::eof())) return traits_type::not_eof(ch_i);
+		if (discard_a) return ch_i;
+
+		cur_a.push_back(traits_type::to_char_type(ch_i));
+		if (cur_a.size() >= bufsize_a) handoff();
+		return ch_i;
+	}
+
+	void QueueBuf::recycle(std::vector<char> && buf_i)
+	{
+		buf_i.clear();
+		free_a.push_back(std::move(buf_i));
+	}
+
+	void QueueBuf::renew()
+	{
+		if (free_a.empty()) {
+			cur_a = std::vector<char>();
+			cur_a.reserve(bufsize_a);
+			Memory::instance()->add(Memory::output_memory, bufsize_a);
+			buffers_a++;
+		} else {
+			cur_a = std::move(free_a.back());
+			free_a.pop_back();
+		}
+	}
+
+	int QueueBuf::sync()
+	{
+		handoff();
+		GRD(mux_a);
+		return failed_a ? -1 : 0;
+	}
+
+	std::streamsize QueueBuf::xsputn(const char * str_i, std::streamsize cnt_i)
+	{
+		std::streamsize left = cnt_i;
+
+		if (discard_a) return cnt_i;
+		while (left > 0) {
+			size_t room = bufsize_a - cur_a.size();
+			size_t len = std::min(room, static_cast<size_t>(left));
+			cur_a.insert(cur_a.end(), str_i, str_i + len);
+			str_i += len;
+			left -= len;
+			if (cur_a.size() >= bufsize_a) handoff();
+		}
+
+		return cnt_i;
+	}
+
+} // Clte namespace
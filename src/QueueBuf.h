@@ -0,0 +1,119 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <streambuf>
+#include <vector>
+
+namespace Clte
+{
+
+	/** Stream buffer collecting output in buffers of a fixed size, which
+	 * subclasses hand to another thread through a bounded queue. Buffers
+	 * the other thread is done with are reused, so memory use is bounded
+	 * by the buffer size times the queue depth. All buffers are accounted
+	 * as output memory. */
+	class QueueBuf : public std::streambuf
+	{
+		protected:
+		// Size of a single buffer
+		size_t bufsize_a;
+
+		// Maximum number of buffers waiting in the queue
+		size_t depth_a;
+
+		// Number of buffers allocated
+		size_t buffers_a;
+
+		// Buffer currently being filled
+		std::vector<char> cur_a;
+
+		// Buffers available for reuse
+		std::vector<std::vector<char> > free_a;
+
+		// Protects free_a, failed_a and the queue of subclasses
+		std::mutex mux_a;
+
+		// Signals changes in the queue of subclasses
+		std::condition_variable cv_a;
+
+		// Set to discard output instead of collecting it
+		bool discard_a;
+
+		// Set when the other thread failed to process a buffer
+		bool failed_a;
+
+		/** Queue cur_a if not empty, called when it is full and on
+		 * sync(). Implementations call renew() after taking cur_a. */
+		virtual void handoff() = 0;
+
+		/** Get the maximum number of queued buffers to wait for, 1 when
+		 * over the memory limit so output is released as soon as
+		 * possible.
+		 * @returns Maximum queue length. */
+		size_t limit() const;
+
+		/** Make a processed buffer available for reuse. Only call with
+		 * mux_a locked.
+		 * @param buf_i Buffer to reuse. */
+		void recycle(std::vector<char> && buf_i);
+
+		/** Replace cur_a, after it was queued, by a reused or new buffer.
+		 * Only call with mux_a locked. */
+		void renew();
+
+		/** @{ std::streambuf implementation */
+		int_type overflow(int_type ch_i) override;
+		std::streamsize xsputn(const char * str_i, std::streamsize cnt_i) override;
+		int sync() override;
+		/** @} */
+
+		public:
+		/** Constructor, allocates the first buffer.
+		 * @param bufsize_i Size of a single buffer.
+		 * @param depth_i Maximum number of queued buffers.
+		 * @throws std::invalid_argument when @p bufsize_i or @p depth_i
+		 * is 0. */
+		QueueBuf(const size_t bufsize_i, const size_t depth_i);
+
+		// Copying would duplicate the queue
+		QueueBuf(const QueueBuf & obj_i) = delete;
+		QueueBuf & operator=(const QueueBuf & obj_i) = delete;
+
+		// Destructor, subclasses stop their thread before
+		virtual ~QueueBuf();
+	};
+
+} // Clte namespace
@@ -30,24 +30,702 @@
  *
  * vim:set ts=4 sw=4 noet: */
 
+#include <algorithm>
+#include <cctype>
+#include <future>
+#include <mutex>
+#include <sstream>
 #include <stdexcept>
+#include <unordered_set>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Driver.h"
 #include "Logger.h"
+#include "Memory.h"
+#include "Outputs.h"
+#include "Stats.h"
 #include "Renderer.h"
+#include "WriterBuf.h"
 
 namespace Clte
 {
+
+	namespace
+	{
+
+		/// Global functions and tables cacheable iteration bodies may use
+		const char * const library[] = {
+			"clte", "ipairs", "math", "next", "pairs", "select", "string", "table", "tonumber", "tostring", "type", "utf8"
+		};
+
+		// Strip leading and trailing white space
+		std::string_view trim(const std::string_view & str_i)
+		{
+			size_t first = str_i.find_first_not_of(" \t\r\n");
+			if (first == std::string_view::npos) return std::string_view();
+			return str_i.substr(first, str_i.find_last_not_of(" \t\r\n") - first + 1);
+		}
+
+		/** Check which iterations Lua code depends on.
+		 * @param code_i Lua code.
+		 * @param level_i Depth of the iteration being cached, as seen from
+		 * the code.
+		 * @returns -1 if the code may use anything but the keys and values
+		 * of iterations up to @p level_i and library functions without
+		 * side effects, 1 if it uses the key at @p level_i, 0 otherwise. */
+		int scope(const std::string_view & code_i, const size_t level_i)
+		{
+			static const std::unordered_set<std::string_view> names = {
+				"and", "break", "do", "else", "elseif", "end", "false", "for", "function", "goto", "if", "in",
+				"local", "nil", "not", "or", "repeat", "return", "then", "true", "until", "while",
+				"clte", "ipairs", "math", "next", "pairs", "select", "string", "table", "tonumber", "tostring", "type", "utf8"
+			};
+			static const std::unordered_set<std::string_view> tables = { "math", "string", "table", "utf8" };
+			size_t pos = 0, len = code_i.size();
+			std::string_view last;
+			char prev = ' ';
+			int res = 0;
+
+			auto space = [&]() { while (pos < len && isspace(static_cast<unsigned char>(code_i[pos]))) pos++; };
+
+			while (space(), pos < len) {
+				char ch = code_i[pos];
+
+				if (ch == '"' || ch == '\'') {
+					for (pos++; pos < len && code_i[pos] != ch; pos++) {
+						if (code_i[pos] == '\\') pos++;
+					}
+					pos++;
+					prev = ch;
+					last = std::string_view();
+				} else if (ch == '.') {
+					size_t dots = 0;
+					for (; pos < len && code_i[pos] == '.'; pos++) dots++;
+					prev = dots == 1 ? '.' : ' ';
+				} else if (isdigit(static_cast<unsigned char>(ch))) {
+					while (pos < len && (isalnum(static_cast<unsigned char>(code_i[pos])) ||
+						(code_i[pos] == '.' && (pos + 1 >= len || code_i[pos + 1] != '.')))) pos++;
+					prev = '0';
+					last = std::string_view();
+				} else if (isalpha(static_cast<unsigned char>(ch)) || ch == '_') {
+					size_t start = pos;
+					while (pos < len && (isalnum(static_cast<unsigned char>(code_i[pos])) || code_i[pos] == '_')) pos++;
+					std::string_view name = code_i.substr(start, pos - start);
+
+					if ((prev == '.' || prev == ':') && last == "clte") {
+						// Only clte.key(n) and clte.value(n) with a literal n
+						if (name != "key" && name != "value") return -1;
+						size_t depth = 1;
+						space();
+						if (pos >= len || code_i[pos++] != '(') return -1;
+						space();
+						if (pos < len && isdigit(static_cast<unsigned char>(code_i[pos]))) {
+							depth = 0;
+							while (pos < len && isdigit(static_cast<unsigned char>(code_i[pos]))) depth = 10 * depth + code_i[pos++] - '0';
+							space();
+						}
+						if (pos >= len || code_i[pos++] != ')' || depth > level_i) return -1;
+						if (name == "key" && depth == level_i) res = 1;
+						prev = ')';
+						last = std::string_view();
+						continue;
+					}
+					if (prev != '.' && prev != ':' && names.count(name) == 0) return -1;
+
+					// Random numbers differ between renders
+					if (prev == '.' && last == "math" && (name == "random" || name == "randomseed")) return -1;
+
+					// Library tables may only be indexed with a literal name,
+					// anything else may reach math.random or change them
+					if (prev != '.' && prev != ':' && tables.count(name) > 0) {
+						space();
+						if (pos >= len || code_i[pos] != '.' || (pos + 1 < len && code_i[pos + 1] == '.')) return -1;
+					}
+					prev = 'a';
+					last = name;
+				} else if ((ch == '-' && pos + 1 < len && code_i[pos + 1] == '-') || (ch == '[' && pos + 1 < len && (code_i[pos + 1] == '[' || code_i[pos + 1] == '='))) {
+					// Comments and long strings are rare in templates
+					return -1;
+				} else if (ch == '=' && pos + 1 < len && code_i[pos + 1] == '=') {
+					pos += 2;
+					prev = '=';
+					last = std::string_view();
+				} else if (ch == '=' && prev != '<' && prev != '>' && prev != '~') {
+					// Assignments may change the libraries
+					return -1;
+				} else {
+					pos++;
+					prev = ch;
+					last = std::string_view();
+				}
+			}
+
+			return res;
+		}
+
+		/** Check which iterations a list of template nodes depends on.
+		 * @param first_i First node of the list.
+		 * @param level_i Depth of the iteration being cached, as seen from
+		 * the nodes.
+		 * @returns See scope(). */
+		int scope(const Template::Node * first_i, const size_t level_i)
+		{
+			int res = 0;
+			auto merge = [&res](const int sub_i) { res = res < 0 || sub_i < 0 ? -1 : std::max(res, sub_i); };
+
+			for (const Template::Node * nd = first_i; res >= 0 && nd != nullptr; nd = nd->next) {
+				switch (nd->type) {
+					case Template::literal_node:
+						break;
+
+					case Template::exec_node:
+						return -1;
+
+					case Template::output_node:
+						merge(scope(nd->text, level_i));
+						break;
+
+					case Template::if_node:
+						merge(scope(nd->text, level_i));
+						merge(scope(nd->body, level_i));
+						merge(scope(nd->alt, level_i));
+						break;
+
+					case Template::iterate_node:
+						merge(scope(nd->text, level_i));
+						merge(scope(nd->body, level_i + 1));
+						break;
+
+					case Template::key_node:
+					case Template::value_node:
+						if (nd->depth > level_i) return -1;
+						if (nd->type == Template::key_node && nd->depth == level_i) merge(1);
+						break;
+				}
+			}
+
+			return res;
+		}
+
+		/** Append a description of a list of template nodes, so equal
+		 * lists of different compiles get equal descriptions.
+		 * @param first_i First node of the list.
+		 * @param out_o String to append the description to. */
+		void signature(const Template::Node * first_i, std::string & out_o)
+		{
+			for (const Template::Node * nd = first_i; nd != nullptr; nd = nd->next) {
+				uint64_t depth = nd->depth, len = nd->text.size();
+				out_o.push_back(static_cast<char>(nd->type));
+				out_o.append(reinterpret_cast<const char *>(&depth), sizeof(depth));
+				out_o.append(reinterpret_cast<const char *>(&len), sizeof(len));
+				out_o.append(nd->text);
+				signature(nd->body, out_o);
+				signature(nd->alt, out_o);
+			}
+
+			// Node types are smaller, so this ends the list
+			out_o.push_back('\xff');
+		}
+
+	} // Anonymous namespace
+
 	Renderer::Renderer()
-	: in_a(nullptr), out_a(nullptr)
-	{ }
+	: in_a(nullptr), binding_a(lua_a), memo_a(lua_a), out_a(nullptr), loops_a(LUA_NOREF), emitter_a(nullptr), main_a(nullptr), outputs_a(nullptr), files_a(nullptr), nextbody_a(0), library_a(LUA_NOREF), renders_a(0), reused_a(0), changed_a(false), pending_a(false), reuse_a(false), pipelined_a(false), stream_a(false)
+	{
+		lua_newtable(lua_a.state());
+		loops_a = luaL_ref(lua_a.state(), LUA_REGISTRYINDEX);
+		lua_a.function("key", &Renderer::key, this);
+		lua_a.function("lookup", &Renderer::lookup, this);
+		lua_a.function("output", &Renderer::output, this);
+		lua_a.function("value", &Renderer::value, this);
+
+		// Copy what cacheable bodies may use, with the fields of library
+		// tables keyed by the table, see reusable()
+		lua_State * L = lua_a.state();
+		lua_newtable(L);
+		clte_pushglobals(L);
+		for (const char * name : library) {
+			lua_pushstring(L, name);
+			lua_rawget(L, -2);
+			if (lua_istable(L, -1)) {
+				lua_pushvalue(L, -1);
+				lua_newtable(L);
+				lua_pushnil(L);
+				while (lua_next(L, -3) != 0) {
+					lua_pushvalue(L, -2);
+					lua_insert(L, -2);
+					lua_rawset(L, -4);
+				}
+				lua_rawset(L, -5);
+			}
+			lua_pushstring(L, name);
+			lua_insert(L, -2);
+			lua_rawset(L, -4);
+		}
+		lua_pop(L, 1);
+		library_a = luaL_ref(L, LUA_REGISTRYINDEX);
+	}
 
 	Renderer::~Renderer()
-	{ }
+	{
+		for (auto & chk : chunks_a) lua_a.release(chk.second.ref);
+		lua_a.release(loops_a);
+		lua_a.release(library_a);
+	}
+
+	void Renderer::bind()
+	{
+		if (data_a.empty()) return;
+
+		index_a.build(data_a);
+		binding_a.bind(data_a);
+		LCET(binding_a.protectedPush(data_a.root(), tplname_a), std::runtime_error, "Unable to bind data from %s", datafile_a.c_str());
+		lua_setglobal(lua_a.state(), "data");
+	}
+
+	const Renderer::Cacheable & Renderer::cacheable(const Template::Node * node_i)
+	{
+		auto it = cacheable_a.find(node_i);
+		if (it != cacheable_a.end()) return it->second;
+
+		// Bodies keep their identifier when recompiling the template
+		Cacheable cch{ scope(node_i->body, 1), 0 };
+		if (cch.scope >= 0) {
+			std::string sig;
+			signature(node_i->body, sig);
+			auto res = bodies_a.emplace(std::move(sig), nextbody_a);
+			if (res.second) nextbody_a++;
+			cch.body = res.first->second;
+		}
+		return cacheable_a.emplace(node_i, cch).first->second;
+	}
+
+	int Renderer::chunk(const Template::Node * node_i)
+	{
+		auto it = chunks_a.find(node_i);
+		if (it == chunks_a.end()) {
+			// Expressions return their value, @! blocks are plain code
+			std::string code(node_i->text);
+			if (node_i->type != Template::exec_node) code = "return " + code;
+
+			Stats::Timer tmr(Stats::compile_time);
+			Chunk chk;
+			chk.ref = lua_a.compile(code, "=" + tplname_a + ":" + std::to_string(node_i->line));
+			chk.unsafe = node_i->type == Template::exec_node || scope(node_i->text, SIZE_MAX) < 0;
+			it = chunks_a.emplace(node_i, chk).first;
+		}
+
+		// Running it may change what cacheable bodies use
+		if (it->second.unsafe) changed_a = true;
+		return it->second.ref;
+	}
+
+	bool Renderer::compile()
+	{
+		Driver drv;
+
+		for (auto & chk : chunks_a) lua_a.release(chk.second.ref);
+		chunks_a.clear();
+
+		// Fragments are cached by body content, see cacheable()
+		cacheable_a.clear();
+
+		// Functions wrapped again by the new template get new identifiers,
+		// so results of the old ones would only take up space
+		memo_a.clear();
+
+		if (!drv.parse(*in_a, tplname_a)) return false;
+		tpl_a = drv.release();
+		return true;
+	}
+
+	bool Renderer::data(const std::string & filename_i, const bool stream_i)
+	{
+		datafile_a = filename_i;
+		stream_a = stream_i;
+		pending_a = !stream_i;
+
+		if (stream_i || pipelined_a) {
+			LCER(access(filename_i.c_str(), R_OK) == 0, false, "Unable to read data file %s", filename_i.c_str());
+			return true;
+		}
+
+		return load();
+	}
+
+	size_t Renderer::elements(const std::function<void(const Data::Node &)> & element_i)
+	{
+		if (stream_a) {
+			return Data::stream(datafile_a, [&element_i](Data & dt_i) { element_i(dt_i.root()); });
+		}
+
+		Data::Node root = data_a.root();
+		if (root.type() != Data::sequence_node) {
+			element_i(root);
+			return 1;
+		}
+
+		for (size_t i = 0; i < root.size(); i++) element_i(root[i]);
+		return root.size();
+	}
+
+	void Renderer::emit(std::ostream & out_i, const std::function<bool(Emitter &)> & body_i)
+	{
+		std::unique_ptr<Outputs> outs;
+		std::unique_ptr<std::ostream> os;
+		Emitter emt(out_i, !pipelined_a);
+		bool ok = false;
+
+		if (!outdir_a.empty()) {
+			outs.reset(new Outputs(outdir_a));
+			os.reset(new std::ostream(outs.get()));
+		}
+
+		// Make the emitter and output files available to clte.output()
+		emitter_a = &emt;
+		main_a = &out_i;
+		outputs_a = outs.get();
+		files_a = os.get();
+		try {
+			Stats::Timer tmr(Stats::render_time);
+			ok = body_i(emt);
+			emt.flush();
+		} catch (...) {
+			emitter_a = nullptr;
+			outputs_a = nullptr;
+			files_a = nullptr;
+			throw;
+		}
+		emitter_a = nullptr;
+		outputs_a = nullptr;
+		files_a = nullptr;
+		lua_a.account();
+
+		LCET(ok, std::runtime_error, "Unable to render template %s", tplname_a.c_str());
+		if (outs) {
+			os->flush();
+			LCET(outs->close(), std::runtime_error, "Error writing output files to %s", outdir_a.c_str());
+			LI("Rendered %zu output files into %s", outs->files(), outdir_a.c_str());
+		}
+	}
+
+	bool Renderer::execute(const Template::Node * node_i, Emitter & out_i)
+	{
+		lua_State * L = lua_a.state();
+		std::string str;
+		int ref = LUA_NOREF;
+		bool cond = false;
+
+		for (const Template::Node * nd = node_i; nd != nullptr; nd = nd->next) {
+			switch (nd->type) {
+				case Template::literal_node:
+					out_i.emit(nd->text, nd->emit);
+					break;
+
+				case Template::output_node:
+					ref = chunk(nd);
+					if (ref == LUA_NOREF || !lua_a.call(ref, 1, tplname_a)) return false;
+					if (!lua_a.tostring(-1, str, tplname_a)) {
+						lua_pop(L, 1);
+						return false;
+					}
+					lua_pop(L, 1);
+					out_i.write(str);
+					break;
+
+				case Template::exec_node:
+					ref = chunk(nd);
+					if (ref == LUA_NOREF || !lua_a.call(ref, 0, tplname_a)) return false;
+					break;
+
+				case Template::if_node:
+					ref = chunk(nd);
+					if (ref == LUA_NOREF || !lua_a.call(ref, 1, tplname_a)) return false;
+					cond = lua_toboolean(L, -1);
+					lua_pop(L, 1);
+					if (!execute(cond ? nd->body : nd->alt, out_i)) return false;
+					break;
+
+				case Template::iterate_node:
+					if (!iterate(nd, out_i)) return false;
+					break;
+
+				case Template::key_node:
+				case Template::value_node:
+					if (!write(nd->depth, nd->type == Template::value_node, nd->line, out_i)) return false;
+					break;
+			}
+		}
+
+		return true;
+	}
+
+	void Renderer::expire()
+	{
+		size_t bytes = 0, count = fragments_a.size();
+
+		// @! blocks may have changed the libraries after the last check
+		reusable();
+
+		for (auto it = fragments_a.begin(); it != fragments_a.end();) {
+			if (reuse_a && it->second.used == renders_a) {
+				++it;
+				continue;
+			}
+			bytes += it->first.bytes.size() + it->second.text.size();
+			it = fragments_a.erase(it);
+		}
+		Memory::instance()->sub(Memory::output_memory, bytes);
+
+		if (reuse_a && count > 0) LD("Reused %zu output fragments, dropped %zu", reused_a, count - fragments_a.size());
+		reused_a = 0;
+
+		// Keep the identifiers of bodies in the current template
+		std::unordered_set<uint64_t> live;
+		for (auto & cch : cacheable_a) live.insert(cch.second.body);
+		for (auto it = bodies_a.begin(); it != bodies_a.end();) {
+			if (live.count(it->second) > 0) ++it;
+			else it = bodies_a.erase(it);
+		}
+	}
 
-	void Renderer::in(std::istream * in_i)
+	bool Renderer::fragment(const Template::Node * node_i, Emitter & out_i)
+	{
+		const uint64_t prime = 0x100000001b3ULL;
+		const Frame & frm = frames_a.back();
+
+		// Other Lua tables may change without notice
+		if (!frm.native) return execute(node_i->body, out_i);
+
+		// The key holds the exact content of the element, so a hash
+		// collision can't reuse the output of another element. The
+		// position only matters when the body uses it.
+		const Cacheable & cch = cacheable(node_i);
+		std::string & bytes = key_a.bytes;
+		uint64_t hash = (0xcbf29ce484222325ULL ^ cch.body) * prime;
+		bytes.assign(reinterpret_cast<const char *>(&cch.body), sizeof(cch.body));
+		seen_a.clear();
+		if (frm.key.data() != nullptr) {
+			bytes.push_back('k');
+			frm.key.encode(bytes, seen_a);
+			hash = frm.key.hash(hash);
+		} else if (cch.scope > 0) {
+			uint64_t idx = frm.index;
+			bytes.push_back('i');
+			bytes.append(reinterpret_cast<const char *>(&idx), sizeof(idx));
+			hash = (hash ^ idx) * prime;
+		}
+		bytes.push_back('v');
+		frm.value.encode(bytes, seen_a);
+		key_a.hash = frm.value.hash(hash);
+
+		auto it = fragments_a.find(key_a);
+		if (it != fragments_a.end()) {
+			it->second.used = renders_a + 1;
+			out_i.write(it->second.text);
+			reused_a++;
+			return true;
+		}
+
+		// Nested iterations reuse key_a while executing the body
+		FragmentKey key{ key_a.hash, bytes };
+		std::ostringstream cap;
+		std::ostream & prev = out_i.stream();
+		bool ok = false;
+		out_i.target(cap);
+		try {
+			ok = execute(node_i->body, out_i);
+		} catch (...) {
+			out_i.target(prev);
+			throw;
+		}
+		out_i.target(prev);
+		if (!ok) return false;
+
+		auto res = fragments_a.emplace(std::move(key), Fragment());
+		Fragment & frg = res.first->second;
+		frg.text = cap.str();
+		frg.used = renders_a + 1;
+		Memory::instance()->add(Memory::output_memory, res.first->first.bytes.size() + frg.text.size());
+		out_i.write(frg.text);
+		return true;
+	}
+
+	void Renderer::generate(const std::function<bool()> & compile_i, const std::function<bool(Emitter &)> & body_i)
+	{
+		// Wait for other renders to finish, a data file that still has to
+		// be loaded is about the size of its image
+		struct stat st;
+		size_t estimate = Emitter::bufsize;
+		if (pending_a && stat(datafile_a.c_str(), &st) == 0) estimate += st.st_size;
+		Memory::Admission adm(estimate);
+
+		if (!pipelined_a) {
+			LCET(load(), std::runtime_error, "Unable to load data from %s", datafile_a.c_str());
+			LCET(compile_i(), std::runtime_error, "Unable to compile template");
+			bind();
+			emit(*out_a, body_i);
+			out_a->flush();
+			LCET(out_a->good(), std::runtime_error, "Error writing rendered output");
+			LD("Avoided %lu string hashes", binding_a.avoided());
+			LD("Pure function calls: %lu hits, %lu misses, %lu uncacheable", memo_a.hits(), memo_a.misses(), memo_a.bypassed());
+			return;
+		}
+
+		// Data loading and template compilation are independent
+		std::future<bool> loaded = std::async(std::launch::async, &Renderer::load, this);
+		bool compiled = compile_i();
+		LCET(loaded.get(), std::runtime_error, "Unable to load data from %s", datafile_a.c_str());
+		LCET(compiled, std::runtime_error, "Unable to compile template");
+
+		bind();
+		WriterBuf wrb(out_a);
+		std::ostream os(&wrb);
+		emit(os, body_i);
+		os.flush();
+		LCET(wrb.close(), std::runtime_error, "Error writing rendered output");
+		LD("Avoided %lu string hashes", binding_a.avoided());
+		LD("Pure function calls: %lu hits, %lu misses, %lu uncacheable", memo_a.hits(), memo_a.misses(), memo_a.bypassed());
+	}
+
+	void Renderer::in(std::istream * in_i, const std::string & name_i)
 	{
 		LCET(in_i != nullptr, std::invalid_argument, "Pointer to input stream may not be NULL");
 		LCET(in_a == nullptr, std::logic_error, "Input stream is already set");
 		in_a = in_i;
+		tplname_a = name_i;
+	}
+
+	bool Renderer::iterate(const Template::Node * node_i, Emitter & out_i)
+	{
+		bool streamed = stream_a && frames_a.empty() && trim(node_i->text) == "data";
+		int ref = streamed ? LUA_NOREF : chunk(node_i);
+
+		if (!streamed && ref == LUA_NOREF) return false;
+		if (reuse_a && !streamed && node_i->body != nullptr && cacheable(node_i).scope >= 0 && reusable()) {
+			return loop(ref, node_i->line, [this, node_i, &out_i]() { return fragment(node_i, out_i); });
+		}
+		return loop(ref, node_i->line, [this, node_i, &out_i]() { return execute(node_i->body, out_i); });
+	}
+
+	int Renderer::key(lua_State * L)
+	{
+		Renderer * rnd = static_cast<Renderer *>(lua_touserdata(L, lua_upvalueindex(1)));
+		lua_Integer depth = luaL_optinteger(L, 1, 1);
+
+		if (depth < 1 || static_cast<size_t>(depth) > rnd->frames_a.size()) {
+			return luaL_error(L, "no key at iteration depth %d", static_cast<int>(depth));
+		}
+		rnd->push(depth, false);
+		return 1;
+	}
+
+	bool Renderer::load()
+	{
+		if (!pending_a) return true;
+
+		Stats::Timer tmr(Stats::load_time);
+		pending_a = false;
+		return data_a.load(datafile_a);
+	}
+
+	bool Renderer::loop(const int ref_i, const uint32_t line_i, const std::function<bool()> & body_i)
+	{
+		lua_State * L = lua_a.state();
+		Data::Node coll;
+		bool ok = true;
+
+		// Streamed elements are only available while they are parsed, so
+		// nothing may refer to an element after its iteration
+		if (ref_i == LUA_NOREF) {
+			size_t idx = 0;
+			elements([&](const Data::Node & elem_i) {
+				if (!ok) return;
+				binding_a.bind(*elem_i.data());
+				frames_a.push_back(Frame{ Data::Node(), elem_i, idx++, true });
+				try {
+					ok = body_i();
+				} catch (...) {
+					frames_a.pop_back();
+					binding_a.unbind();
+					throw;
+				}
+				frames_a.pop_back();
+				binding_a.unbind();
+			});
+			return ok;
+		}
+
+		if (!lua_a.call(ref_i, 1, tplname_a)) return false;
+
+		// Data sequences and maps never enter Lua to iterate
+		if (binding_a.node(-1, coll)) {
+			lua_pop(L, 1);
+			bool seq = coll.type() == Data::sequence_node;
+			for (size_t i = 0; ok && i < coll.size(); i++) {
+				if (seq) frames_a.push_back(Frame{ Data::Node(), coll[i], i, true });
+				else frames_a.push_back(Frame{ coll.key(i), coll.value(i), i, true });
+				ok = body_i();
+				frames_a.pop_back();
+			}
+			return ok;
+		}
+
+		if (lua_isnil(L, -1)) {
+			lua_pop(L, 1);
+			return true;
+		}
+
+		if (!lua_istable(L, -1)) {
+			LE("%s:%u: Unable to iterate over a %s value", tplname_a.c_str(), line_i, luaL_typename(L, -1));
+			lua_pop(L, 1);
+			return false;
+		}
+
+		// Other tables, keep the current key and value in loops_a
+		LCER(lua_checkstack(L, 4), false, "%s:%u: Iterations nested too deeply", tplname_a.c_str(), line_i);
+		int tbl = lua_gettop(L);
+		int slot = 2 * frames_a.size() + 1;
+		lua_rawgeti(L, LUA_REGISTRYINDEX, loops_a);
+		frames_a.push_back(Frame{ Data::Node(), Data::Node(), 0, false });
+		lua_pushnil(L);
+		while (lua_next(L, tbl) != 0) {
+			lua_pushvalue(L, -2);
+			lua_rawseti(L, tbl + 1, slot);
+			lua_rawseti(L, tbl + 1, slot + 1);
+			if (!body_i()) {
+				lua_pop(L, 1);
+				ok = false;
+				break;
+			}
+			frames_a.back().index++;
+		}
+		frames_a.pop_back();
+
+		// Don't keep the last key and value alive
+		lua_pushnil(L);
+		lua_rawseti(L, tbl + 1, slot);
+		lua_pushnil(L);
+		lua_rawseti(L, tbl + 1, slot + 1);
+		lua_pop(L, 2);
+		return ok;
+	}
+
+	int Renderer::lookup(lua_State * L)
+	{
+		Renderer * rnd = static_cast<Renderer *>(lua_touserdata(L, lua_upvalueindex(1)));
+		size_t speclen = 0, keylen = 0;
+		const char * spec = luaL_checklstring(L, 1, &speclen);
+		const char * key = luaL_checklstring(L, 2, &keylen);
+		const std::vector<uint32_t> * nodes = nullptr;
+
+		// No C++ objects may be alive when lua_error() jumps out
+		if (!rnd->index_a.find(std::string_view(spec, speclen), std::string_view(key, keylen), nodes)) {
+			return luaL_error(L, "no data index %s", spec);
+		}
+		if (nodes == nullptr) lua_newtable(L);
+		else rnd->binding_a.list(*nodes);
+		return 1;
 	}
 
 	void Renderer::out(std::ostream * out_i)
@@ -57,10 +735,185 @@ namespace Clte
 		out_a = out_i;
 	}
 
+	bool Renderer::outdir(const std::string & dir_i)
+	{
+		struct stat st;
+
+		LCER(stat(dir_i.c_str(), &st) == 0 && S_ISDIR(st.st_mode), false, "Output directory %s doesn't exist", dir_i.c_str());
+		LCER(access(dir_i.c_str(), W_OK) == 0, false, "Output directory %s isn't writable", dir_i.c_str());
+		outdir_a = dir_i;
+		return true;
+	}
+
+	int Renderer::output(lua_State * L)
+	{
+		Renderer * rnd = static_cast<Renderer *>(lua_touserdata(L, lua_upvalueindex(1)));
+		const char * name = luaL_optstring(L, 1, nullptr);
+
+		// No C++ objects may be alive when lua_error() jumps out
+		if (!rnd->retarget(name)) return luaL_error(L, "unable to switch output to %s", name == nullptr ? "the main output" : name);
+		return 0;
+	}
+
+	void Renderer::push(const size_t depth_i, const bool value_i)
+	{
+		lua_State * L = lua_a.state();
+		size_t level = frames_a.size() - depth_i;
+		const Frame & frm = frames_a[level];
+
+		if (!frm.native) {
+			lua_rawgeti(L, LUA_REGISTRYINDEX, loops_a);
+			lua_rawgeti(L, -1, 2 * level + (value_i ? 2 : 1));
+			lua_remove(L, -2);
+		} else if (value_i) {
+			binding_a.push(frm.value);
+		} else if (frm.key.data() != nullptr) {
+			binding_a.push(frm.key);
+		} else {
+			lua_pushinteger(L, frm.index + 1);
+		}
+	}
+
 	void Renderer::render()
 	{
 		LCET(in_a != nullptr, std::logic_error, "Input stream pointer wasn't set, call in() first.");
 		LCET(out_a != nullptr, std::logic_error, "Output stream pointer wasn't set, call out() first.");
+
+		generate([this]() { return compile(); }, [this](Emitter & out_i) { return execute(tpl_a->root(), out_i); });
+		renders_a++;
+		expire();
+	}
+
+	void Renderer::rerender(std::ostream * out_i, std::istream * in_i, const bool data_i)
+	{
+		LCET(out_i != nullptr, std::invalid_argument, "Pointer to output stream may not be NULL");
+		LCET(tpl_a || in_i != nullptr, std::logic_error, "No template compiled yet, call render() first.");
+
+		out_a = out_i;
+		if (in_i != nullptr) in_a = in_i;
+		if (data_i && !stream_a) pending_a = true;
+		generate([this, in_i]() { return in_i == nullptr || compile(); }, [this](Emitter & out_i) { return execute(tpl_a->root(), out_i); });
+		renders_a++;
+		expire();
+	}
+
+	bool Renderer::retarget(const char * name_i)
+	{
+		LCER(emitter_a != nullptr, false, "clte.output() can only be used while rendering");
+
+		try {
+			if (name_i == nullptr) {
+				emitter_a->target(*main_a);
+				if (outputs_a != nullptr) outputs_a->deselect();
+				return true;
+			}
+
+			LCER(outputs_a != nullptr, false, "No output directory set for clte.output(\"%s\")", name_i);
+			emitter_a->target(*files_a);
+			outputs_a->select(name_i);
+		} catch (const std::exception &) {
+			// Already logged
+			return false;
+		}
+
+		return true;
+	}
+
+	bool Renderer::reusable()
+	{
+		if (!reuse_a || !changed_a) return reuse_a;
+		changed_a = false;
+
+		lua_State * L = lua_a.state();
+		int top = lua_gettop(L);
+		bool same = true;
+
+		// Compare raw values, metamethods could run any code
+		lua_rawgeti(L, LUA_REGISTRYINDEX, library_a);
+		clte_pushglobals(L);
+		for (size_t i = 0; same && i < sizeof(library) / sizeof(library[0]); i++) {
+			lua_pushstring(L, library[i]);
+			lua_rawget(L, top + 2);
+			lua_pushstring(L, library[i]);
+			lua_rawget(L, top + 1);
+			same = lua_rawequal(L, top + 3, top + 4) != 0;
+			if (same && lua_istable(L, top + 3)) {
+				// Library tables may neither change nor get a metatable
+				same = lua_getmetatable(L, top + 3) == 0;
+				lua_pushvalue(L, top + 3);
+				lua_rawget(L, top + 1);
+				int copy = lua_gettop(L);
+				long fields = 0;
+
+				lua_pushnil(L);
+				while (same && lua_next(L, top + 3) != 0) {
+					lua_pushvalue(L, -2);
+					lua_rawget(L, copy);
+					same = lua_rawequal(L, -1, -2) != 0;
+					lua_pop(L, 2);
+					fields++;
+				}
+				if (same) {
+					lua_pushnil(L);
+					while (lua_next(L, copy) != 0) {
+						lua_pop(L, 1);
+						fields--;
+					}
+					same = fields == 0;
+				}
+			}
+			lua_settop(L, top + 2);
+		}
+		lua_settop(L, top);
+
+		if (!same) {
+			LW("@! blocks changed the standard libraries, no longer reusing output fragments");
+			reuse_a = false;
+		}
+		return reuse_a;
+	}
+
+	int Renderer::value(lua_State * L)
+	{
+		Renderer * rnd = static_cast<Renderer *>(lua_touserdata(L, lua_upvalueindex(1)));
+		lua_Integer depth = luaL_optinteger(L, 1, 1);
+
+		if (depth < 1 || static_cast<size_t>(depth) > rnd->frames_a.size()) {
+			return luaL_error(L, "no value at iteration depth %d", static_cast<int>(depth));
+		}
+		rnd->push(depth, true);
+		return 1;
+	}
+
+	bool Renderer::write(const size_t depth_i, const bool value_i, const uint32_t line_i, Emitter & out_i)
+	{
+		std::string str;
+
+		LCER(depth_i >= 1 && depth_i <= frames_a.size(), false, "%s:%u: No %s at iteration depth %zu", tplname_a.c_str(), line_i, value_i ? "value" : "key", depth_i);
+
+		// Scalars and positions are written without entering Lua
+		const Frame & frm = frames_a[frames_a.size() - depth_i];
+		if (frm.native) {
+			if (!value_i && frm.key.data() == nullptr) {
+				out_i.write(std::to_string(frm.index + 1));
+				return true;
+			}
+			Data::Node nd = value_i ? frm.value : frm.key;
+			if (nd.type() == Data::null_node) return true;
+			if (nd.type() == Data::scalar_node) {
+				out_i.write(nd.scalar());
+				return true;
+			}
+			if (!binding_a.protectedPush(nd, tplname_a)) return false;
+		} else {
+			push(depth_i, value_i);
+		}
+
+		bool ok = lua_a.tostring(-1, str, tplname_a);
+		lua_pop(lua_a.state(), 1);
+		if (!ok) return false;
+		out_i.write(str);
+		return true;
 	}
 
 } // Clte namespace
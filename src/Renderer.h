@@ -32,8 +32,22 @@
 
 #pragma once
 
+#include <cstdint>
+#include <functional>
 #include <istream>
+#include <memory>
 #include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Binding.h"
+#include "Data.h"
+#include "Emit.h"
+#include "Index.h"
+#include "Lua.h"
+#include "Memo.h"
+#include "Outputs.h"
+#include "Template.h"
 
 namespace Clte
 {
@@ -43,38 +57,377 @@ namespace Clte
 	class Renderer
 	{
 		protected:
+		/// Iteration of a @$ block in progress
+		struct Frame {
+			Data::Node key;   ///< Key of the current map pair, null otherwise
+			Data::Node value; ///< Current value
+			size_t index;     ///< Zero based position of the current value
+			bool native;      ///< False when iterating over a Lua table
+		};
+
+		/// Compiled Lua chunk of a template node
+		struct Chunk {
+			int ref;     ///< Registry reference to the chunk, LUA_NOREF on errors
+			bool unsafe; ///< True if running it may change the standard libraries
+		};
+
+		/// Cacheability of an iteration body, see cacheable()
+		struct Cacheable {
+			int scope;     ///< -1 if not cacheable, 1 if using the key, 0 otherwise
+			uint64_t body; ///< Identifier of the body content, equal across compiles
+		};
+
+		/// Key of a cached fragment: body identifier and exact element content
+		struct FragmentKey {
+			uint64_t hash;     ///< Hash of the body identifier and element
+			std::string bytes; ///< Body identifier and encoded element
+
+			inline bool operator==(const FragmentKey & obj_i) const { return hash == obj_i.hash && bytes == obj_i.bytes; }
+		};
+
+		/// Hash function of fragment keys, using their precalculated hash
+		struct FragmentHash {
+			inline size_t operator()(const FragmentKey & key_i) const { return key_i.hash; }
+		};
+
+		/// Cached output of an iteration body for a single element
+		struct Fragment {
+			std::string text; ///< Rendered output
+			uint64_t used;    ///< Render in which it was last used
+		};
+
+		// Data document to fill the template with
+		Data data_a;
+
+		// Data file to read from
+		std::string datafile_a;
+
+		// Name of the template, used in error messages
+		std::string tplname_a;
+
+		// Compiled template
+		std::unique_ptr<Template> tpl_a;
+
 		// Input stream to use
 		std::istream * in_a;
 
+		// Lua state to evaluate template expressions in
+		Lua lua_a;
+
+		// Binding of data_a into lua_a
+		Binding binding_a;
+
+		// Secondary indexes over data_a
+		Index index_a;
+
+		// Cache of clte.pure() function results
+		Memo memo_a;
+
 		// Output stream to use
 		std::ostream * out_a;
 
+		// Compiled Lua chunks of template nodes
+		std::unordered_map<const Template::Node *, Chunk> chunks_a;
+
+		// Stack of iterations in progress, innermost last
+		std::vector<Frame> frames_a;
+
+		// Registry reference to the keys and values of Lua table iterations
+		int loops_a;
+
+		// Emitter of the render in progress, NULL when not rendering
+		Emitter * emitter_a;
+
+		// Main output stream of the render in progress
+		std::ostream * main_a;
+
+		// Output files of the render in progress, NULL if none
+		Outputs * outputs_a;
+
+		// Stream writing to outputs_a
+		std::ostream * files_a;
+
+		// Directory for files selected with clte.output(), empty if none
+		std::string outdir_a;
+
+		// Cached output of iteration bodies by body and element
+		std::unordered_map<FragmentKey, Fragment, FragmentHash> fragments_a;
+
+		// Key of the fragment being looked up, reused to avoid allocations
+		FragmentKey key_a;
+
+		// Nodes encoded into key_a so far, see Data::Node::encode()
+		std::unordered_map<uint32_t, uint32_t> seen_a;
+
+		// Iteration nodes whose body output only depends on the element,
+		// see cacheable()
+		std::unordered_map<const Template::Node *, Cacheable> cacheable_a;
+
+		// Identifiers of iteration bodies by their content, so fragments
+		// survive recompiling the template
+		std::unordered_map<std::string, uint64_t> bodies_a;
+
+		// Identifier for the next new iteration body
+		uint64_t nextbody_a;
+
+		// Registry reference to a copy of the standard library functions
+		// and tables cacheable bodies may use, see reusable()
+		int library_a;
+
+		// Number of renders so far, to expire unused fragments
+		uint64_t renders_a;
+
+		// Number of fragments reused in the current render
+		size_t reused_a;
+
+		// True if unsafe chunks ran since the last reusable() check
+		bool changed_a;
+
+		// True if datafile_a still has to be loaded
+		bool pending_a;
+
+		// True to cache and reuse the output of iterations
+		bool reuse_a;
+
+		// True when running load, compile and output in parallel
+		bool pipelined_a;
+
+		// True when streaming datafile_a instead of loading it
+		bool stream_a;
+
+		/** Build the data indexes and bind the loaded data document into
+		 * Lua as the global "data". Nothing is bound in streaming mode. */
+		void bind();
+
+		/** Check whether the output of an iteration body only depends on
+		 * the element iterated over, so it can be cached. That is the case
+		 * when the body has no @! blocks and its Lua code only uses keys
+		 * and values of this or inner iterations and a few standard
+		 * library functions without side effects. The result is cached as
+		 * well.
+		 * @param node_i Iteration node.
+		 * @returns Scope and body identifier of the iteration. */
+		const Cacheable & cacheable(const Template::Node * node_i);
+
+		/** Get the compiled Lua chunk of a template node, compiling it on
+		 * first use.
+		 * @param node_i Template node.
+		 * @returns Registry reference to the chunk, LUA_NOREF on errors. */
+		int chunk(const Template::Node * node_i);
+
+		/** Compile the template read from the input stream.
+		 * @returns True if successful, false if not. */
+		bool compile();
+
+		/** Iterate over the elements of the top-level data sequence. In
+		 * streaming mode the elements are parsed on the fly, one at a time,
+		 * otherwise they are taken from the loaded document.
+		 * @param element_i Callback receiving each element.
+		 * @returns Number of elements iterated over. */
+		size_t elements(const std::function<void(const Data::Node &)> & element_i);
+
+		/** Execute the template through an emitter, including output files
+		 * selected with clte.output().
+		 * @param out_i Main output stream.
+		 * @param body_i Executes the template, writing to the emitter.
+		 * @throws std::runtime_error when executing or writing fails */
+		void emit(std::ostream & out_i, const std::function<bool(Emitter &)> & body_i);
+
+		/** Execute a list of template nodes.
+		 * @param node_i First node of the list.
+		 * @param out_i Emitter to write the result to.
+		 * @returns True if successful, false if not. */
+		bool execute(const Template::Node * node_i, Emitter & out_i);
+
+		/** Drop the fragments not used by the last render, and all of them
+		 * when @! blocks changed the standard libraries. */
+		void expire();
+
+		/** Execute an iteration body for the innermost element, reusing
+		 * its output from an earlier render if the element didn't change.
+		 * @param node_i Iteration node.
+		 * @param out_i Emitter to write the result to.
+		 * @returns True if successful, false if not. */
+		bool fragment(const Template::Node * node_i, Emitter & out_i);
+
+		/** Load the data, compile the template and execute it, in parallel
+		 * in pipelined mode. Shared by render() and compiled templates.
+		 * @param compile_i Compiles the template.
+		 * @param body_i Executes the template, writing to the emitter.
+		 * @throws std::runtime_error when loading data, compiling the
+		 * template or writing output fails */
+		void generate(const std::function<bool()> & compile_i, const std::function<bool(Emitter &)> & body_i);
+
+		/** Execute an iteration node, see loop().
+		 * @param node_i Iteration node.
+		 * @param out_i Emitter to write the result to.
+		 * @returns True if successful, false if not. */
+		bool iterate(const Template::Node * node_i, Emitter & out_i);
+
+		/** Lua: clte.key(n), push the key of the n-th innermost iteration.
+		 * Sequences have the 1-based position as key. */
+		static int key(lua_State * L);
+
+		/** Load the data file if that was deferred.
+		 * @returns True if successful or nothing to load, false if not. */
+		bool load();
+
+		/** Execute an iteration. Sequences and maps from the data document
+		 * are iterated natively in document order, other Lua tables with
+		 * Lua's next().
+		 * @param ref_i Registry reference to the chunk returning the
+		 * collection, LUA_NOREF to iterate over the streamed elements.
+		 * @param line_i Template line, for error messages.
+		 * @param body_i Executes the body once for every element.
+		 * @returns True if successful, false if not. */
+		bool loop(const int ref_i, const uint32_t line_i, const std::function<bool()> & body_i);
+
+		/** Lua: clte.lookup(index, key), push a sequence of all elements
+		 * having the value key in the index declared as index, in document
+		 * order. The sequence is cached by the binding, see
+		 * Binding::list(). */
+		static int lookup(lua_State * L);
+
+		/** Lua: clte.output(name), write following output to the file name
+		 * in the output directory. Without name, switch back to the main
+		 * output. */
+		static int output(lua_State * L);
+
+		/** Push the key or value of an iteration onto the Lua stack. This
+		 * may raise Lua errors, so only call it from a C function called
+		 * by Lua.
+		 * @param depth_i Depth of the iteration, 1 for the innermost.
+		 * @param value_i True for the value, false for the key. */
+		void push(const size_t depth_i, const bool value_i);
+
+		/** Switch the output of the render in progress.
+		 * @param name_i Name of the output file, NULL for the main output.
+		 * @returns True if successful, false if not. */
+		bool retarget(const char * name_i);
+
+		/** Check whether fragments may still be reused. When unsafe code
+		 * ran since the last check, this compares the library functions
+		 * and tables cacheable bodies may use with the copy taken when
+		 * this renderer was created, and disables reuse for good if @!
+		 * blocks changed them.
+		 * @returns True if reuse is enabled and safe, false if not. */
+		bool reusable();
+
+		/** Lua: clte.value(n), push the value of the n-th innermost
+		 * iteration. */
+		static int value(lua_State * L);
+
+		/** Write the key or value of an iteration to the output.
+		 * @param depth_i Depth of the iteration, 1 for the innermost.
+		 * @param value_i True for the value, false for the key.
+		 * @param line_i Template line, for error messages.
+		 * @param out_i Emitter to write to.
+		 * @returns True if successful, false if not. */
+		bool write(const size_t depth_i, const bool value_i, const uint32_t line_i, Emitter & out_i);
+
 		public:
 		// Default constructor
 		Renderer();
 
-		// Default destructor
-		~Renderer();
+		// Default destructor, virtual for subclasses like Native
+		virtual ~Renderer();
 
-		/** Read the data to use from a file.
-		 * @param filename_i Filename to read YAML data from.
-		 * @returns True if successful, false if not. */
-		bool data(const std::string & filename_i);
+		/** Read the data to use from a file. Precompiled data files (see
+		 * Data::save()) are mapped into memory without parsing.
+		 * @param filename_i Filename to read YAML or precompiled data from.
+		 * @param stream_i Stream the elements of a top-level sequence
+		 * while rendering instead of loading the whole document first.
+		 * Only for YAML files that don't fit in memory, default false.
+		 * @returns True if successful, false if not. In pipelined mode
+		 * loading is deferred to render(), so only the existence of the
+		 * file is checked. */
+		bool data(const std::string & filename_i, const bool stream_i = false);
+
+		/** Enable or disable reusing the output of iterations over elements
+		 * that didn't change since the previous render, see rerender().
+		 * Iteration bodies with @! blocks or using more than the element
+		 * are always rendered again.
+		 * @param reuse_i True to enable, false to disable. */
+		inline void fragments(const bool reuse_i) { reuse_a = reuse_i; }
+
+		/** Get the number of string hashes avoided by pushing interned data
+		 * strings into Lua.
+		 * @returns Number of avoided hashing calls so far. */
+		inline uint64_t hashesAvoided() const { return binding_a.avoided(); }
+
+		/** Get the Lua state templates are executed in, e.g. to register
+		 * additional functions before rendering.
+		 * @returns Reference to the Lua state. */
+		inline Lua & lua() { return lua_a; }
+
+		/** Get the number of calls of clte.pure() functions answered from
+		 * the memoisation cache.
+		 * @returns Number of cache hits so far. */
+		inline uint64_t memoHits() const { return memo_a.hits(); }
+
+		/** Get the number of calls of clte.pure() functions that had to call
+		 * the function.
+		 * @returns Number of cache misses so far. */
+		inline uint64_t memoMisses() const { return memo_a.misses(); }
 
 		/** Set the input stream to read the template from.
 		 * @param in_i Pointer to input stream.
+		 * @param name_i Name of the template for error messages, default
+		 * "template".
 		 * @throws std::invalid_argument when @p in_i is NULL
 		 * @throws std::logic_error when input stream is already set */
-		void in(std::istream * in_i);
+		void in(std::istream * in_i, const std::string & name_i = "template");
+
+		/** Declare a secondary index over the data, built once when the
+		 * data is loaded. Templates look up elements with
+		 * clte.lookup("path:field", value). Not available when streaming.
+		 * @param spec_i Index declaration "path:field", see Index.
+		 * @returns True if successful, false if malformed. */
+		inline bool index(const std::string & spec_i) { return index_a.declare(spec_i); }
 
 		/** Set the output stream to write to.
 		 * @param out_i Pointer to output stream.
 		 * @throws std::invalid_argument when @p out_i is NULL
 		 * @throws std::logic_error when output stream is already set */
-		void out(std::istream * out_i);
+		void out(std::ostream * out_i);
 
-		/** Render the input template to the output. */
-		void render();
+		/** Set the directory for output files. Templates select the file
+		 * to write to with clte.output(name) and switch back to the main
+		 * output with clte.output(). Output files are written by a
+		 * background thread while rendering continues.
+		 * @param dir_i Existing, writable directory.
+		 * @returns True if successful, false if not. */
+		bool outdir(const std::string & dir_i);
+
+		/** Enable or disable pipelined rendering. In pipelined mode the
+		 * data file is loaded in a separate thread while the template is
+		 * compiled, and output is handed to a dedicated writer thread in
+		 * large buffers while rendering continues.
+		 * @param pipelined_i True to enable, false to disable. */
+		inline void pipelined(const bool pipelined_i) { pipelined_a = pipelined_i; }
+
+		/** Render the input template to the output. With a memory limit
+		 * set (see Memory::limit()), this first waits until the data and
+		 * output buffers of this render fit within the limit.
+		 * @throws std::logic_error when the input or output stream is not set
+		 * @throws std::runtime_error when loading data, compiling the
+		 * template or writing output fails */
+		virtual void render();
+
+		/** Render again after render(), e.g. when watching files for
+		 * changes. The compiled template and loaded data are kept unless
+		 * they changed. With fragments() enabled, the output of iterations
+		 * over unchanged elements is reused.
+		 * @param out_i Output stream to write to, replacing the previous
+		 * one. Only used during this call.
+		 * @param in_i Input stream of the changed template, only used
+		 * during this call, NULL if the template didn't change.
+		 * @param data_i True to load the data file again.
+		 * @throws std::invalid_argument when @p out_i is NULL
+		 * @throws std::logic_error when no template was compiled yet
+		 * @throws std::runtime_error when loading data, compiling the
+		 * template or writing output fails */
+		void rerender(std::ostream * out_i, std::istream * in_i, const bool data_i);
 
 	};
 
@@ -0,0 +1,74 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#pragma once
+
+#include <istream>
+
+// FlexLexer.h has no include guard of its own
+#if !defined(yyFlexLexerOnce)
+#include <FlexLexer.h>
+#endif
+
+#include "parser.hh"
+
+/** Signature of the scanner function generated by flex. */
+#undef YY_DECL
+#define YY_DECL \
+	yy::parser::symbol_type Clte::Scanner::lex(Clte::Driver & drv_i)
+
+namespace Clte
+{
+
+	class Driver;
+
+	/** Template scanner. All scanner state lives in the instance, so every
+	 * Driver can have its own Scanner and templates can be scanned in
+	 * parallel. */
+	class Scanner : public yyFlexLexer
+	{
+		protected:
+		// Read input, counting the bytes read in the statistics
+		int LexerInput(char * buf_o, int max_i) override;
+
+		public:
+		/** Constructor.
+		 * @param in_i Input stream to scan. */
+		Scanner(std::istream * in_i);
+
+		/** Scan the next token.
+		 * @param drv_i Driver to keep the token location in.
+		 * @returns Next token. */
+		yy::parser::symbol_type lex(Driver & drv_i);
+	};
+
+} // Clte namespace
@@ -34,6 +34,7 @@
 
 #include <stdlib.h>
 #include <memory>
+#include <mutex>
 #include "commondefs.h"
 
 namespace Fs2a {
@@ -0,0 +1,127 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <fstream>
+#include "Logger.h"
+#include "Stats.h"
+
+namespace Clte
+{
+
+	Stats::Local::Local()
+	{
+		for (int i = 0; i < counters; i++) values[i] = 0;
+
+		Stats * sts = Stats::instance();
+		GRD(sts->mux_a);
+		sts->live_a.insert(this);
+		sts->threads_a++;
+	}
+
+	Stats::Local::~Local()
+	{
+		Stats * sts = Stats::instance();
+		GRD(sts->mux_a);
+		for (int i = 0; i < counters; i++) sts->retired_a[i] += values[i].load(std::memory_order_relaxed);
+		sts->live_a.erase(this);
+	}
+
+	Stats::Stats()
+	: threads_a(0)
+	{
+		for (int i = 0; i < counters; i++) retired_a[i] = 0;
+	}
+
+	Stats::~Stats()
+	{ }
+
+	void Stats::json(std::ostream & out_i) const
+	{
+		out_i << "{\n";
+		for (int i = 0; i < counters; i++) {
+			counter_t cnt = static_cast<counter_t>(i);
+			out_i << "\t\"" << name(cnt) << "\": " << total(cnt) << ",\n";
+		}
+		out_i << "\t\"threads\": " << threads() << "\n}\n";
+	}
+
+	Stats::Local & Stats::local()
+	{
+		thread_local Local lcl;
+		return lcl;
+	}
+
+	const char * Stats::name(const counter_t counter_i)
+	{
+		switch (counter_i) {
+			case parse_time: return "parse_ns";
+			case compile_time: return "compile_ns";
+			case load_time: return "load_ns";
+			case render_time: return "render_ns";
+			case write_time: return "write_ns";
+			case bytes_in: return "bytes_in";
+			case bytes_out: return "bytes_out";
+			case lua_allocs: return "lua_allocations";
+			case cache_hits: return "cache_hits";
+			case cache_misses: return "cache_misses";
+			case index_time: return "index_ns";
+			default: return "unknown";
+		}
+	}
+
+	bool Stats::save(const std::string & filename_i) const
+	{
+		std::ofstream ofs(filename_i, std::ios::trunc);
+
+		LCER(ofs.good(), false, "Unable to open statistics file %s", filename_i.c_str());
+		json(ofs);
+		ofs.close();
+		LCER(ofs.good(), false, "Unable to write statistics to %s", filename_i.c_str());
+		return true;
+	}
+
+	size_t Stats::threads() const
+	{
+		GRD(mux_a);
+		return threads_a;
+	}
+
+	uint64_t Stats::total(const counter_t counter_i) const
+	{
+		GRD(mux_a);
+		uint64_t sum = retired_a[counter_i];
+
+		for (const Local * lcl : live_a) sum += lcl->values[counter_i].load(std::memory_order_relaxed);
+		return sum;
+	}
+
+} // Clte namespace
@@ -0,0 +1,173 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <set>
+#include <string>
+#include "Singleton.h"
+
+namespace Clte
+{
+
+	/** Always-on run statistics: time spent per phase and a number of
+	 * counters. Every thread counts into its own thread-local block, which
+	 * needs no locking. The blocks of all threads are merged when the
+	 * statistics are read. */
+	class Stats : public Fs2a::Singleton<Stats>
+	{
+		// Singleton template as friend for construction
+		friend class Fs2a::Singleton<Stats>;
+
+		public:
+		/// Counters, phase times are in nanoseconds
+		enum counter_t : uint8_t {
+			parse_time = 0,   ///< Scanning and parsing templates
+			compile_time = 1, ///< Compiling Lua chunks
+			load_time = 2,    ///< Loading data files
+			render_time = 3,  ///< Executing templates, including writes
+			write_time = 4,   ///< Writing output
+			bytes_in = 5,     ///< Bytes of templates and data read
+			bytes_out = 6,    ///< Bytes of output written
+			lua_allocs = 7,   ///< Lua allocations
+			cache_hits = 8,   ///< Pure function cache hits
+			cache_misses = 9, ///< Pure function cache misses
+			index_time = 10,  ///< Building data indexes
+			counters = 11     ///< Number of counters
+		};
+
+		/** Adds the time between construction and destruction to a
+		 * phase counter. */
+		class Timer
+		{
+			protected:
+			// Counter to add to
+			counter_t counter_a;
+
+			// Start time
+			std::chrono::steady_clock::time_point start_a;
+
+			public:
+			/** Constructor, starts timing.
+			 * @param counter_i Counter to add the elapsed time to. */
+			inline Timer(const counter_t counter_i)
+			: counter_a(counter_i), start_a(std::chrono::steady_clock::now())
+			{ }
+
+			// Destructor, adds the elapsed time
+			inline ~Timer()
+			{
+				auto dur = std::chrono::steady_clock::now() - start_a;
+				add(counter_a, std::chrono::duration_cast<std::chrono::nanoseconds>(dur).count());
+			}
+		};
+
+		private:
+		// Default constructor
+		Stats();
+
+		// Copy constructor
+		Stats(const Stats & obj_i) = delete;
+
+		// Assignment constructor
+		Stats & operator=(const Stats & obj_i) = delete;
+
+		// Destructor
+		~Stats();
+
+		protected:
+		/// Counters of a single thread
+		struct Local {
+			std::atomic<uint64_t> values[counters]; ///< Only written by the owning thread
+
+			/// Constructor, registers with the Stats instance
+			Local();
+
+			/// Destructor, merges into the Stats instance
+			~Local();
+		};
+
+		// Protects live_a, retired_a and threads_a
+		mutable std::mutex mux_a;
+
+		// Counters of running threads
+		std::set<Local *> live_a;
+
+		// Counters of finished threads
+		uint64_t retired_a[counters];
+
+		// Number of threads that counted anything
+		size_t threads_a;
+
+		// Counters of the calling thread
+		static Local & local();
+
+		public:
+		/** Add to a counter of the calling thread.
+		 * @param counter_i Counter to add to.
+		 * @param value_i Value to add. */
+		static inline void add(const counter_t counter_i, const uint64_t value_i)
+		{
+			std::atomic<uint64_t> & val = local().values[counter_i];
+			val.store(val.load(std::memory_order_relaxed) + value_i, std::memory_order_relaxed);
+		}
+
+		/** Write all counters as a JSON object.
+		 * @param out_i Output stream to write to. */
+		void json(std::ostream & out_i) const;
+
+		/** Get the name of a counter.
+		 * @param counter_i Counter.
+		 * @returns Name used as JSON key. */
+		static const char * name(const counter_t counter_i);
+
+		/** Write all counters as JSON to a file.
+		 * @param filename_i Name of the file to write.
+		 * @returns True if successful, false if not. */
+		bool save(const std::string & filename_i) const;
+
+		/** Get the number of threads that counted anything.
+		 * @returns Number of threads. */
+		size_t threads() const;
+
+		/** Get the total of a counter over all threads.
+		 * @param counter_i Counter.
+		 * @returns Total value. */
+		uint64_t total(const counter_t counter_i) const;
+	};
+
+} // Clte namespace
@@ -0,0 +1,152 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <cstring>
+#include "Memory.h"
+#include "Template.h"
+
+namespace Clte
+{
+
+	Template::Template(const std::string & name_i)
+	: arena_a(64 * 1024), name_a(name_i), root_a(nullptr), bytes_a(0), memory_a(Memory::instance()), accounted_a(0), nodes_a(0)
+	{ }
+
+	Template::~Template()
+	{
+		memory_a->sub(Memory::template_memory, accounted_a);
+	}
+
+	void Template::account()
+	{
+		memory_a->add(Memory::template_memory, bytes_a - accounted_a);
+		accounted_a = bytes_a;
+	}
+
+	void * Template::allocate(const size_t size_i, const size_t align_i)
+	{
+		bytes_a += size_i;
+		return arena_a.allocate(size_i, align_i);
+	}
+
+	Template::List Template::append(const List & list_i, Node * node_i)
+	{
+		if (list_i.tail == nullptr) return List{ node_i, node_i };
+
+		list_i.tail->next = node_i;
+		return List{ list_i.head, node_i };
+	}
+
+	std::string_view Template::copy(const std::string_view & str_i)
+	{
+		if (str_i.empty()) return std::string_view();
+
+		char * buf = static_cast<char *>(allocate(str_i.size(), 1));
+		memcpy(buf, str_i.data(), str_i.size());
+		return std::string_view(buf, str_i.size());
+	}
+
+	std::string_view Template::join(const std::vector<std::string_view> & parts_i)
+	{
+		size_t len = 0;
+
+		if (parts_i.size() == 1) return parts_i.front();
+		for (const std::string_view & part : parts_i) len += part.size();
+		if (len == 0) return std::string_view();
+
+		char * buf = static_cast<char *>(allocate(len, 1));
+		char * pos = buf;
+		for (const std::string_view & part : parts_i) {
+			memcpy(pos, part.data(), part.size());
+			pos += part.size();
+		}
+		return std::string_view(buf, len);
+	}
+
+	size_t Template::merge()
+	{
+		return merge(root_a);
+	}
+
+	size_t Template::merge(Node * first_i)
+	{
+		size_t merged = 0;
+
+		for (Node * nd = first_i; nd != nullptr; nd = nd->next) {
+			if (nd->body != nullptr) merged += merge(nd->body);
+			if (nd->alt != nullptr) merged += merge(nd->alt);
+			if (nd->type != literal_node) continue;
+			if (nd->next == nullptr || nd->next->type != literal_node) {
+				nd->emit = Emit::classify(nd->text.size());
+				continue;
+			}
+
+			// Find the end and total length of this run of literals
+			Node * last = nd;
+			size_t len = nd->text.size();
+			while (last->next != nullptr && last->next->type == literal_node) {
+				last = last->next;
+				len += last->text.size();
+				merged++;
+			}
+
+			char * buf = static_cast<char *>(allocate(len, 1));
+			char * pos = buf;
+			for (Node * lit = nd; lit != last->next; lit = lit->next) {
+				memcpy(pos, lit->text.data(), lit->text.size());
+				pos += lit->text.size();
+			}
+			nd->text = std::string_view(buf, len);
+			nd->emit = Emit::classify(len);
+			nd->next = last->next;
+		}
+
+		return merged;
+	}
+
+	Template::Node * Template::node(const type_t type_i, const uint32_t line_i, const std::string_view & text_i)
+	{
+		Node * nd = static_cast<Node *>(allocate(sizeof(Node), alignof(Node)));
+
+		nodes_a++;
+		nd->type = type_i;
+		nd->emit = Emit::classify(text_i.size());
+		nd->line = line_i;
+		nd->depth = 0;
+		nd->text = text_i;
+		nd->body = nullptr;
+		nd->alt = nullptr;
+		nd->next = nullptr;
+		return nd;
+	}
+
+} // Clte namespace
@@ -0,0 +1,181 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#pragma once
+
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Emit.h"
+
+namespace Clte
+{
+
+	class Memory;
+
+	/** Compiled template. All nodes and strings of a template are allocated
+	 * from a single monotonic arena, which is released at once when the
+	 * template is destroyed. Nodes are trivially destructible for that
+	 * reason and only refer to strings inside the same arena. */
+	class Template
+	{
+		public:
+		/// Node types
+		enum type_t : uint8_t {
+			literal_node = 0, ///< Literal text
+			output_node = 1,  ///< @= expression @.
+			exec_node = 2,    ///< @! code @;
+			if_node = 3,      ///< @? condition @. body [@: alt] @;
+			iterate_node = 4, ///< @$ expression @. body @;
+			key_node = 5,     ///< @^ with depth
+			value_node = 6    ///< @+ with depth
+		};
+
+		/// Single node of the syntax tree
+		struct Node {
+			type_t type;           ///< Node type
+			Emit::class_t emit;    ///< Size class of literal text
+			uint32_t line;         ///< Template line, for error messages
+			size_t depth;          ///< Iteration depth of key and value nodes
+			std::string_view text; ///< Literal text or Lua code
+			Node * body;           ///< First node of the (then) block
+			Node * alt;            ///< First node of the else block
+			Node * next;           ///< Next sibling
+		};
+
+		/// List of sibling nodes being built by the parser
+		struct List {
+			Node * head; ///< First node, NULL if empty
+			Node * tail; ///< Last node, NULL if empty
+		};
+
+		protected:
+		// Arena all nodes and strings are allocated from
+		std::pmr::monotonic_buffer_resource arena_a;
+
+		// Name of the template
+		std::string name_a;
+
+		// First node of the template
+		Node * root_a;
+
+		// Number of bytes allocated from the arena
+		size_t bytes_a;
+
+		// Memory accounting, looked up once
+		Memory * memory_a;
+
+		// Number of bytes reported to memory_a so far
+		size_t accounted_a;
+
+		// Number of nodes allocated
+		size_t nodes_a;
+
+		// Allocate raw bytes from the arena
+		void * allocate(const size_t size_i, const size_t align_i);
+
+		// Merge adjacent literal nodes in a list and its blocks
+		size_t merge(Node * first_i);
+
+		public:
+		/** Constructor.
+		 * @param name_i Name of the template. */
+		Template(const std::string & name_i);
+
+		// Copying would duplicate the arena
+		Template(const Template & obj_i) = delete;
+		Template & operator=(const Template & obj_i) = delete;
+
+		// Destructor, releases the arena
+		~Template();
+
+		/** Report the bytes allocated since the last call to the memory
+		 * accounting. Called once after parsing, instead of for every
+		 * single allocation. */
+		void account();
+
+		/** Append a node to a list.
+		 * @param list_i List to append to.
+		 * @param node_i Node to append.
+		 * @returns Extended list. */
+		static List append(const List & list_i, Node * node_i);
+
+		/** Get the number of bytes allocated from the arena.
+		 * @returns Allocated bytes. */
+		inline size_t bytes() const { return bytes_a; }
+
+		/** Copy a string into the arena.
+		 * @param str_i String to copy.
+		 * @returns View on the copy. */
+		std::string_view copy(const std::string_view & str_i);
+
+		/** Concatenate strings into the arena. A single string is returned
+		 * as is.
+		 * @param parts_i Strings to concatenate, in order.
+		 * @returns View on the concatenation. */
+		std::string_view join(const std::vector<std::string_view> & parts_i);
+
+		/** Merge all adjacent literal nodes into single nodes with one
+		 * contiguous text each. Comments, indentation tabs and escaped at
+		 * signs split literal text into many small pieces while parsing,
+		 * this joins them back so rendering copies a few large runs. The
+		 * size class of every literal is determined here as well.
+		 * @returns Number of literal nodes merged away. */
+		size_t merge();
+
+		/** Get the name of the template.
+		 * @returns Template name. */
+		inline const std::string & name() const { return name_a; }
+
+		/** Allocate a new node.
+		 * @param type_i Node type.
+		 * @param line_i Line in the template.
+		 * @param text_i Literal text or Lua code, must be in the arena.
+		 * @returns Pointer to the node, all other fields zeroed. */
+		Node * node(const type_t type_i, const uint32_t line_i, const std::string_view & text_i = std::string_view());
+
+		/** Get the number of nodes allocated.
+		 * @returns Number of nodes. */
+		inline size_t nodes() const { return nodes_a; }
+
+		/** Get the first node of the template.
+		 * @returns First node, NULL for an empty template. */
+		inline const Node * root() const { return root_a; }
+
+		/** Set the first node of the template.
+		 * @param root_i First node. */
+		inline void root(Node * root_i) { root_a = root_i; }
+	};
+
+} // Clte namespace
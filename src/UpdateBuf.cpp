@@ -0,0 +1,198 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Logger.h"
+#include "UpdateBuf.h"
+
+namespace Clte
+{
+
+	UpdateBuf::UpdateBuf(const std::string & filename_i, const size_t chunk_i)
+	: filename_a(filename_i), chunk_a(chunk_i), old_a(nullptr), oldsize_a(0), same_a(0), mode_a(0666),
+	  fd_a(-1), failed_a(false), changed_a(false), exists_a(false), closed_a(false)
+	{
+		struct stat st;
+
+		LCET(chunk_i > 0, std::invalid_argument, "Chunk size must be positive");
+		setp(chunk_a.data(), chunk_a.data() + chunk_a.size());
+
+		int fd = open(filename_a.c_str(), O_RDONLY);
+		if (fd < 0) {
+			LCET(errno == ENOENT, std::runtime_error, "Unable to open %s: %s", filename_a.c_str(), strerror(errno));
+			mode_t um = umask(0);
+			umask(um);
+			mode_a = 0666 & ~um;
+			return;
+		}
+
+		if (fstat(fd, &st) != 0) {
+			::close(fd);
+			LCET(false, std::runtime_error, "Unable to stat %s: %s", filename_a.c_str(), strerror(errno));
+		}
+		exists_a = true;
+		mode_a = st.st_mode & 07777;
+		oldsize_a = st.st_size;
+
+		if (oldsize_a > 0) {
+			void * ptr = mmap(nullptr, oldsize_a, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (ptr == MAP_FAILED) {
+				::close(fd);
+				LCET(false, std::runtime_error, "Unable to map %s: %s", filename_a.c_str(), strerror(errno));
+			}
+			old_a = static_cast<const char *>(ptr);
+		}
+		::close(fd);
+	}
+
+	UpdateBuf::~UpdateBuf()
+	{
+		close();
+	}
+
+	bool UpdateBuf::close()
+	{
+		if (closed_a) return !failed_a;
+		closed_a = true;
+
+		drain();
+
+		// Shorter output or a new file also means writing
+		if (!failed_a && fd_a < 0 && (same_a < oldsize_a || !exists_a)) diverge();
+
+		if (fd_a >= 0) {
+			if (!failed_a && fchmod(fd_a, mode_a) != 0) {
+				LE("Unable to set permissions of %s: %s", tmpname_a.c_str(), strerror(errno));
+				failed_a = true;
+			}
+			if (::close(fd_a) != 0 && !failed_a) {
+				LE("Error closing %s: %s", tmpname_a.c_str(), strerror(errno));
+				failed_a = true;
+			}
+			fd_a = -1;
+			if (!failed_a && rename(tmpname_a.c_str(), filename_a.c_str()) != 0) {
+				LE("Unable to rename %s to %s: %s", tmpname_a.c_str(), filename_a.c_str(), strerror(errno));
+				failed_a = true;
+			}
+			if (failed_a) unlink(tmpname_a.c_str());
+		}
+
+		unmap();
+		LCD(changed_a, "%s is unchanged, not written", filename_a.c_str());
+		return !failed_a;
+	}
+
+	bool UpdateBuf::diverge()
+	{
+		std::vector<char> tmpl(filename_a.begin(), filename_a.end());
+		const char suffix[] = ".XXXXXX";
+
+		tmpl.insert(tmpl.end(), suffix, suffix + sizeof(suffix));
+		fd_a = mkstemp(tmpl.data());
+		if (fd_a < 0) {
+			LE("Unable to create temporary file for %s: %s", filename_a.c_str(), strerror(errno));
+			failed_a = true;
+			return false;
+		}
+
+		tmpname_a.assign(tmpl.data());
+		changed_a = true;
+		LD("Output differs from %s after %zu bytes", filename_a.c_str(), same_a);
+		if (same_a > 0 && !write(old_a, same_a)) return false;
+		unmap();
+		return true;
+	}
+
+	bool UpdateBuf::drain()
+	{
+		size_t len = pptr() - pbase();
+
+		if (len > 0 && !failed_a) {
+			if (fd_a < 0 && same_a + len <= oldsize_a && memcmp(old_a + same_a, pbase(), len) == 0) {
+				same_a += len;
+			} else if (fd_a >= 0 || diverge()) {
+				write(pbase(), len);
+			}
+		}
+
+		setp(chunk_a.data(), chunk_a.data() + chunk_a.size());
+		return !failed_a;
+	}
+
+	UpdateBuf::int_type UpdateBuf::overflow(int_type ch_i)
+	{
+		if (!drain()) return traits_type::eof();
+		if (traits_type::eq_int_type(ch_i, traits_type::eof())) return traits_type::not_eof(ch_i);
+
+		*pptr() = traits_type::to_char_type(ch_i);
+		pbump(1);
+		return ch_i;
+	}
+
+	int UpdateBuf::sync()
+	{
+		return drain() ? 0 : -1;
+	}
+
+	void UpdateBuf::unmap()
+	{
+		if (old_a == nullptr) return;
+
+		munmap(const_cast<char *>(old_a), oldsize_a);
+		old_a = nullptr;
+	}
+
+	bool UpdateBuf::write(const char * buf_i, size_t size_i)
+	{
+		while (size_i > 0) {
+			ssize_t res = ::write(fd_a, buf_i, size_i);
+			if (res < 0 && errno == EINTR) continue;
+			if (res < 0) {
+				LE("Error writing to %s: %s", tmpname_a.c_str(), strerror(errno));
+				failed_a = true;
+				return false;
+			}
+			buf_i += res;
+			size_i -= res;
+		}
+		return true;
+	}
+
+} // Clte namespace
@@ -0,0 +1,130 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#pragma once
+
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace Clte
+{
+
+	/** Stream buffer that only writes a file when its content changes.
+	 * Output is compared chunk by chunk against a memory map of the
+	 * existing file. Only at the first difference a temporary file is
+	 * created next to it, which receives the identical prefix and all
+	 * following output and atomically replaces the existing file on
+	 * close(). When the output turns out identical, the existing file is
+	 * not touched at all, so its modification time stays the same. */
+	class UpdateBuf : public std::streambuf
+	{
+		protected:
+		// Name of the file to update
+		std::string filename_a;
+
+		// Name of the temporary file, empty while still comparing
+		std::string tmpname_a;
+
+		// Chunk of output collected before comparing or writing it
+		std::vector<char> chunk_a;
+
+		// Memory map of the existing file, NULL if there is none
+		const char * old_a;
+
+		// Size of the existing file
+		size_t oldsize_a;
+
+		// Number of bytes found identical to the existing file
+		size_t same_a;
+
+		// Permissions of the existing file, or the default for new files
+		unsigned int mode_a;
+
+		// Temporary file descriptor, -1 while still comparing
+		int fd_a;
+
+		// Set when an error occurred
+		bool failed_a;
+
+		// Set when the output differs from the existing file
+		bool changed_a;
+
+		// Set when the file existed before
+		bool exists_a;
+
+		// Set once close() was called
+		bool closed_a;
+
+		// Compare or write the collected chunk and reset the put area
+		bool drain();
+
+		// Switch to writing: create the temporary file with the same prefix
+		bool diverge();
+
+		// Release the memory map of the existing file
+		void unmap();
+
+		// Write all bytes to the temporary file
+		bool write(const char * buf_i, size_t size_i);
+
+		/** @{ std::streambuf implementation */
+		int_type overflow(int_type ch_i) override;
+		int sync() override;
+		/** @} */
+
+		public:
+		/** Constructor, maps the existing file if there is one.
+		 * @param filename_i Name of the file to update.
+		 * @param chunk_i Size of the comparison chunks, default 64 KiB.
+		 * @throws std::runtime_error when the existing file can't be read. */
+		UpdateBuf(const std::string & filename_i, const size_t chunk_i = 64 * 1024);
+
+		// Copying would duplicate the file descriptor and map
+		UpdateBuf(const UpdateBuf & obj_i) = delete;
+		UpdateBuf & operator=(const UpdateBuf & obj_i) = delete;
+
+		// Destructor, closes if not closed yet
+		~UpdateBuf();
+
+		/** Check whether the output differs from the existing file. Only
+		 * final after close().
+		 * @returns True if the file was (or will be) replaced. */
+		inline bool changed() const { return changed_a; }
+
+		/** Finish comparing or writing. Replaces the existing file when the
+		 * output differs and removes the temporary file on errors.
+		 * @returns True if successful, false if not. */
+		bool close();
+	};
+
+} // Clte namespace
@@ -0,0 +1,103 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include "Logger.h"
+#include "Watcher.h"
+
+namespace Clte
+{
+
+	Watcher::Watcher(const std::string & datafile_i, const std::string & tplfile_i)
+	: fd_a(-1)
+	{
+		fd_a = inotify_init1(IN_CLOEXEC);
+		LCET(fd_a >= 0, std::runtime_error, "Unable to initialize inotify: %s", strerror(errno));
+
+		bool ok = watch(datafile_i, data_a) && watch(tplfile_i, tpl_a);
+		if (!ok) close(fd_a);
+		LCET(ok, std::runtime_error, "Unable to watch %s and %s for changes", datafile_i.c_str(), tplfile_i.c_str());
+	}
+
+	Watcher::~Watcher()
+	{
+		if (fd_a >= 0) close(fd_a);
+	}
+
+	bool Watcher::wait(bool & data_o, bool & tpl_o, const int settle_i)
+	{
+		alignas(struct inotify_event) char buf[4096];
+		int timeout = -1;
+
+		data_o = false;
+		tpl_o = false;
+		for (;;) {
+			struct pollfd pfd = { fd_a, POLLIN, 0 };
+			int res = poll(&pfd, 1, timeout);
+			if (res < 0 && errno == EINTR) continue;
+			LCER(res >= 0, false, "Unable to wait for file changes: %s", strerror(errno));
+			if (res == 0) return true;
+
+			ssize_t len = read(fd_a, buf, sizeof(buf));
+			if (len < 0 && errno == EINTR) continue;
+			LCER(len > 0, false, "Unable to read file changes: %s", strerror(errno));
+			for (char * pos = buf; pos < buf + len;) {
+				const struct inotify_event * evt = reinterpret_cast<const struct inotify_event *>(pos);
+				pos += sizeof(struct inotify_event) + evt->len;
+				if (evt->len == 0) continue;
+				if (evt->wd == data_a.wd && data_a.name == evt->name) data_o = true;
+				if (evt->wd == tpl_a.wd && tpl_a.name == evt->name) tpl_o = true;
+			}
+
+			// Editors write in several steps, wait for the last one
+			if (data_o || tpl_o) timeout = settle_i;
+		}
+	}
+
+	bool Watcher::watch(const std::string & path_i, File & file_o)
+	{
+		size_t slash = path_i.rfind('/');
+
+		file_o.dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path_i.substr(0, slash);
+		file_o.name = slash == std::string::npos ? path_i : path_i.substr(slash + 1);
+		file_o.wd = inotify_add_watch(fd_a, file_o.dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+		LCER(file_o.wd >= 0, false, "Unable to watch %s: %s", file_o.dir.c_str(), strerror(errno));
+		LD("Watching %s in %s", file_o.name.c_str(), file_o.dir.c_str());
+		return true;
+	}
+
+} // Clte namespace
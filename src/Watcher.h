@@ -0,0 +1,90 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#pragma once
+
+#include <string>
+
+namespace Clte
+{
+
+	/** Waits for changes of a data file and a template with inotify, for
+	 * clite --watch. The directories of the files are watched instead of
+	 * the files themselves, so files replaced by editors that write a new
+	 * file and rename it over the old one are noticed as well. */
+	class Watcher
+	{
+		protected:
+		/// Watched file
+		struct File {
+			std::string dir;  ///< Directory of the file
+			std::string name; ///< Name of the file in dir
+			int wd;           ///< Watch descriptor of dir
+		};
+
+		// Watched data file
+		File data_a;
+
+		// Watched template
+		File tpl_a;
+
+		// Inotify file descriptor
+		int fd_a;
+
+		// Start watching the directory of a file
+		bool watch(const std::string & path_i, File & file_o);
+
+		public:
+		/** Constructor, starts watching.
+		 * @param datafile_i Data file to watch.
+		 * @param tplfile_i Template to watch.
+		 * @throws std::runtime_error when watching isn't possible. */
+		Watcher(const std::string & datafile_i, const std::string & tplfile_i);
+
+		// Copying would close the inotify descriptor twice
+		Watcher(const Watcher & obj_i) = delete;
+		Watcher & operator=(const Watcher & obj_i) = delete;
+
+		// Destructor, stops watching
+		~Watcher();
+
+		/** Wait for the next change. Changes following each other closely
+		 * are combined, so a file is only reported once it is settled.
+		 * @param data_o Set to true if the data file changed.
+		 * @param tpl_o Set to true if the template changed.
+		 * @param settle_i Time in milliseconds without further changes
+		 * before returning, default 50.
+		 * @returns True if something changed, false on errors. */
+		bool wait(bool & data_o, bool & tpl_o, const int settle_i = 50);
+	};
+
+} // Clte namespace
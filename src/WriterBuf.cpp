@@ -0,0 +1,113 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <stdexcept>
+#include "Logger.h"
+#include "Stats.h"
+#include "WriterBuf.h"
+
+namespace Clte
+{
+
+	WriterBuf::WriterBuf(std::ostream * out_i, const size_t bufsize_i, const size_t depth_i)
+	: QueueBuf(bufsize_i, depth_i), out_a(out_i), done_a(false)
+	{
+		LCET(out_i != nullptr, std::invalid_argument, "Pointer to output stream may not be NULL");
+		thread_a = std::thread(&WriterBuf::writer, this);
+	}
+
+	WriterBuf::~WriterBuf()
+	{
+		close();
+	}
+
+	bool WriterBuf::close()
+	{
+		if (thread_a.joinable()) {
+			handoff();
+			{
+				GRD(mux_a);
+				done_a = true;
+			}
+			cv_a.notify_all();
+			thread_a.join();
+			out_a->flush();
+		}
+
+		GRD(mux_a);
+		return !failed_a && out_a->good();
+	}
+
+	void WriterBuf::handoff()
+	{
+		if (cur_a.empty()) return;
+
+		// Over the memory limit, wait until everything queued is written
+		std::unique_lock<std::mutex> lck(mux_a);
+		cv_a.wait(lck, [this]() { return queue_a.size() < limit(); });
+		queue_a.push_back(std::move(cur_a));
+		renew();
+		lck.unlock();
+		cv_a.notify_all();
+	}
+
+	void WriterBuf::writer()
+	{
+		std::unique_lock<std::mutex> lck(mux_a);
+
+		for (;;) {
+			cv_a.wait(lck, [this]() { return done_a || !queue_a.empty(); });
+			if (queue_a.empty()) break;
+
+			std::vector<char> buf = std::move(queue_a.front());
+			queue_a.pop_front();
+			lck.unlock();
+			cv_a.notify_all();
+
+			bool good = false;
+			{
+				Stats::Timer tmr(Stats::write_time);
+				out_a->write(buf.data(), buf.size());
+				good = out_a->good();
+			}
+			if (good) Stats::add(Stats::bytes_out, buf.size());
+
+			lck.lock();
+			if (!good && !failed_a) {
+				LE("Error writing %zu bytes of output", buf.size());
+				failed_a = true;
+			}
+			recycle(std::move(buf));
+		}
+	}
+
+} // Clte namespace
@@ -0,0 +1,89 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#pragma once
+
+#include <deque>
+#include <ostream>
+#include <thread>
+#include <vector>
+#include "QueueBuf.h"
+
+namespace Clte
+{
+
+	/** Stream buffer collecting output in large buffers, which are handed
+	 * to a dedicated writer thread through a bounded queue. This lets
+	 * rendering continue while previous output is being written. When the
+	 * queue is full, the rendering thread waits for the writer to catch
+	 * up, so memory use is bounded by the buffer size times the queue
+	 * depth. When the global memory limit is exceeded, buffers are not
+	 * queued but written as soon as possible. */
+	class WriterBuf : public QueueBuf
+	{
+		protected:
+		// Output stream the writer thread writes to
+		std::ostream * out_a;
+
+		// Buffers waiting to be written
+		std::deque<std::vector<char> > queue_a;
+
+		// Writer thread
+		std::thread thread_a;
+
+		// Set when no more buffers will be queued
+		bool done_a;
+
+		// Queue the current buffer and start a fresh one
+		void handoff() override;
+
+		// Writer thread main loop
+		void writer();
+
+		public:
+		/** Constructor, starts the writer thread.
+		 * @param out_i Output stream to write to.
+		 * @param bufsize_i Size of a single buffer, default 1 MiB.
+		 * @param depth_i Maximum number of queued buffers, default 4.
+		 * @throws std::invalid_argument when @p out_i is NULL or
+		 * @p bufsize_i or @p depth_i is 0. */
+		WriterBuf(std::ostream * out_i, const size_t bufsize_i = 1 << 20, const size_t depth_i = 4);
+
+		// Destructor, closes if not closed yet
+		~WriterBuf();
+
+		/** Write all pending output and stop the writer thread.
+		 * @returns True if all output was written successfully. */
+		bool close();
+	};
+
+} // Clte namespace
@@ -30,9 +30,21 @@
  *
  * vim:set ts=4 sw=4 noet: */
 
+#include <chrono>
 #include <cstring>
+#include <fstream>
+#include <memory>
+#include <vector>
 #include <boost/program_options.hpp>
+#include "CodeGen.h"
+#include "Data.h"
+#include "Driver.h"
 #include "Logger.h"
+#include "Memory.h"
+#include "Renderer.h"
+#include "Stats.h"
+#include "UpdateBuf.h"
+#include "Watcher.h"
 
 namespace po = boost::program_options;
 using std::cerr, std::endl;
@@ -53,83 +65,193 @@ void help(const char *argv0)
 	exit(1);
 }
 
+/** Parse a size with an optional K, M or G suffix.
+ * @param str_i Size to parse.
+ * @returns Size in bytes.
+ * @throws std::invalid_argument when @p str_i is not a valid size */
+size_t parseSize(const std::string & str_i)
+{
+	size_t pos = 0, size = 0;
+
+	try {
+		size = std::stoull(str_i, &pos);
+	} catch (const std::exception &) {
+		pos = 0;
+	}
+	LCET(pos > 0, std::invalid_argument, "Invalid size %s", str_i.c_str());
+
+	std::string sfx = str_i.substr(pos);
+	if (sfx == "G" || sfx == "g") size <<= 30;
+	else if (sfx == "M" || sfx == "m") size <<= 20;
+	else if (sfx == "K" || sfx == "k") size <<= 10;
+	else LCET(sfx.empty(), std::invalid_argument, "Invalid size suffix in %s", str_i.c_str());
+	return size;
+}
+
+/** Render again whenever the data file or template changes, until an
+ * error occurs while watching. Errors while rendering are logged and the
+ * next change is waited for.
+ * @param rnd_i Renderer that rendered the template before.
+ * @param datafile_i Data file to watch.
+ * @param tplfile_i Template to watch.
+ * @param outfile_i Output file to write.
+ * @param update_i True to only replace the output file when changed. */
+void watch(Clte::Renderer & rnd_i, const std::string & datafile_i, const std::string & tplfile_i, const std::string & outfile_i, const bool update_i)
+{
+	Clte::Watcher wtc(datafile_i, tplfile_i);
+	bool data = false, tpl = false;
+
+	LI("Watching %s and %s for changes", datafile_i.c_str(), tplfile_i.c_str());
+	while (wtc.wait(data, tpl)) {
+		auto start = std::chrono::steady_clock::now();
+
+		try {
+			std::ifstream in;
+			if (tpl) {
+				in.open(tplfile_i);
+				LCET(in.good(), std::runtime_error, "Unable to open template file %s", tplfile_i.c_str());
+			}
+			std::ofstream ofs;
+			std::unique_ptr<Clte::UpdateBuf> upb;
+			std::ostream ups(nullptr);
+			if (update_i) {
+				upb.reset(new Clte::UpdateBuf(outfile_i));
+				ups.rdbuf(upb.get());
+			} else {
+				ofs.open(outfile_i, std::ios::binary | std::ios::trunc);
+				LCET(ofs.good(), std::runtime_error, "Unable to open output file %s", outfile_i.c_str());
+			}
+			rnd_i.rerender(upb ? &ups : &ofs, tpl ? &in : nullptr, data);
+			if (upb) LCET(upb->close(), std::runtime_error, "Unable to update output file %s", outfile_i.c_str());
+		} catch (const std::exception & se) {
+			LE("Rendering failed, waiting for the next change: %s", se.what());
+			continue;
+		}
+
+		std::chrono::duration<double, std::milli> dur = std::chrono::steady_clock::now() - start;
+		LI("Rendered %s in %.1f ms", outfile_i.c_str(), dur.count());
+	}
+
+	throw 1;
+}
+
 int main(int argc, char *argv[])
 {
 	size_t strp = strlen(STR(REPOROOT))+1;
 	Fs2a::Logger::instance()->stderror(strp);
-	std::string outfile;
+	std::string cppfile, datafile, maxmem, outdir, outfile, statsfile, tplfile, yamlfile;
+	std::vector<std::string> indexes;
+	int res = 0;
 
 	try {
 		po::options_description desc("C++ & Lua Template Engine command-line interface.\nCommand-line options:");
 		desc.add_options()
 			("help,h", "Show this help message on standard error")
+			("compile-data,c", po::value<std::string>(&yamlfile), "Compile a YAML data file into a precompiled .clted data file, written to the output file")
+			("emit-cpp", po::value<std::string>(&cppfile), "Translate a template into C++ source for a generator program linked against libclte, written to the output file or standard out")
+			("max-memory,m", po::value<std::string>(&maxmem), "Limit memory use in bytes, or with a K, M or G suffix. Renders wait for memory and output is flushed early when exceeded")
+			("output-dir,d", po::value<std::string>(&outdir), "Directory for the files a template writes with clte.output()")
 			("output,o", po::value<std::string>(&outfile), "Set the output file instead of standard out")
+			("index,i", po::value<std::vector<std::string> >(&indexes)->composing(), "Build a hash index over a data sequence, given as path:field, for clte.lookup(). Can be given more than once")
+			("if-changed,u", "Only replace the output file if the rendered output differs from it")
+			("pipeline,p", "Load data and compile the template in parallel and write output in a separate thread")
+			("stats", po::value<std::string>(&statsfile), "Write run statistics as JSON to the given file at exit")
+			("stream-data,S", "Stream the top-level sequence of a YAML data file instead of loading it at once, aliases may not refer to other elements")
 			("syslog,s", "Log to syslog instead of standard error")
+			("watch,w", "Keep running and render again whenever the data file or template changes, reusing the output of iterations over unchanged data")
+		;
+		po::options_description hidden;
+		hidden.add_options()
+			("data", po::value<std::string>(&datafile), "Data file")
+			("template", po::value<std::string>(&tplfile), "Template file")
 		;
+		po::options_description all;
+		all.add(desc).add(hidden);
+		po::positional_options_description pos;
+		pos.add("data", 1).add("template", 1);
 		po::variables_map vm;
-		po::store(po::parse_command_line(argc, argv, desc), vm);
+		po::store(po::command_line_parser(argc, argv).options(all).positional(pos).run(), vm);
 		po::notify(vm);
-		if (vm.count("help") {
+		if (vm.count("help")) {
 			cerr << desc << endl;
 			throw 0;
 		}
 
-		if (vm.count("syslog") {
+		if (vm.count("syslog")) {
 			Fs2a::Logger::instance()->syslog("clite", LOG_USER, strp);
 			LD("Logging to syslog (instead of stderror)");
 		}
 
-/*	do {
-		switch (c = getopt_long(argc, argv, "ho:", opts, NULL)) {
-			case -1: // End of options
-				break;
+		if (!maxmem.empty()) Clte::Memory::instance()->limit(parseSize(maxmem));
 
-			case 'o':
-				outf.open(optarg);
-				if (!outf.good()) {
-					outf.close();
-					cerr << "Error opening output file " << optarg << endl;
-					exit(1);
-				}
-				break;
-
-			default:
-				help(argv[0]);
-				break;
+		if (vm.count("compile-data")) {
+			LCET(!outfile.empty(), std::invalid_argument, "Compiling data requires an output file, use -o");
+			Clte::Data dt;
+			if (!dt.yaml(yamlfile) || !dt.save(outfile)) throw 1;
+			LI("Compiled %s into %s", yamlfile.c_str(), outfile.c_str());
+			throw 0;
+		}
 
+		if (vm.count("emit-cpp")) {
+			Clte::Driver drv;
+			std::ifstream src(cppfile);
+			LCET(src.good(), std::runtime_error, "Unable to open template file %s", cppfile.c_str());
+			if (!drv.parse(src, cppfile)) throw 1;
+			std::unique_ptr<Clte::Template> tpl = drv.release();
+			std::ofstream cpp;
+			if (!outfile.empty()) {
+				cpp.open(outfile, std::ios::binary | std::ios::trunc);
+				LCET(cpp.good(), std::runtime_error, "Unable to open output file %s", outfile.c_str());
+			}
+			Clte::CodeGen gen;
+			if (!gen.generate(*tpl, outfile.empty() ? std::cout : cpp)) throw 1;
+			throw 0;
 		}
-	} while (c != -1);
 
-	if (argc != 3) {
-		cerr << "Invalid number of arguments " << argc-1;
-		cerr << " given, should be 2 after parsing options." << endl;
-		exit(1);
-	}
+		LCET(!datafile.empty() && !tplfile.empty(), std::invalid_argument, "Both a data file and a template file are required");
+		std::ifstream tpl(tplfile);
+		LCET(tpl.good(), std::runtime_error, "Unable to open template file %s", tplfile.c_str());
+		std::ofstream ofs;
+		std::unique_ptr<Clte::UpdateBuf> upb;
+		std::ostream ups(nullptr);
+		if (!outfile.empty() && vm.count("if-changed")) {
+			upb.reset(new Clte::UpdateBuf(outfile));
+			ups.rdbuf(upb.get());
+		} else if (!outfile.empty()) {
+			ofs.open(outfile, std::ios::binary | std::ios::trunc);
+			LCET(ofs.good(), std::runtime_error, "Unable to open output file %s", outfile.c_str());
+		}
 
-	try {
-		// Loadfile(argv[1]);
-		if (outf.good()) {
-			// ProcessTemplate(argv[2], outfile);
-		} else {
-			// ProcessTemplate(argv[2], std::cout);
+		if (vm.count("watch")) {
+			LCET(!outfile.empty(), std::invalid_argument, "Watching requires an output file, use -o");
+			LCET(!vm.count("stream-data"), std::invalid_argument, "Watching doesn't support streamed data");
 		}
-	} catch (std::exception & e) {
-		cerr << "Exception: " << e.what() << endl;
-		outfile.close();
-		return 1;
-	}
 
-	outfile.close(); */
+		Clte::Renderer rnd;
+		rnd.fragments(vm.count("watch") > 0);
+		rnd.pipelined(vm.count("pipeline") > 0);
+		for (const std::string & idx : indexes) {
+			if (!rnd.index(idx)) throw 1;
+		}
+		if (!rnd.data(datafile, vm.count("stream-data") > 0)) throw 1;
+		if (!outdir.empty() && !rnd.outdir(outdir)) throw 1;
+		rnd.in(&tpl, tplfile);
+		rnd.out(upb ? &ups : outfile.empty() ? &std::cout : &ofs);
+		rnd.render();
+		if (upb) LCET(upb->close(), std::runtime_error, "Unable to update output file %s", outfile.c_str());
+		Clte::Memory::instance()->report();
+		if (vm.count("watch")) watch(rnd, datafile, tplfile, outfile, vm.count("if-changed") > 0);
 
 	} catch (const std::exception & se) {
 		LE("Caught general exception: %s", se.what());
-		return 1;
+		res = 1;
 	} catch (const int & i) {
-		return i;
+		res = i;
 	} catch (...) {
 		LE("Uncaught exception occurred");
-		return 1;
+		res = 1;
 	}
 
-	return 0;
+	if (!statsfile.empty() && !Clte::Stats::instance()->save(statsfile) && res == 0) res = 1;
+	return res;
 }
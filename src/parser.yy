@@ -30,15 +30,23 @@
  *
  * vim:set ts=4 sw=4 noet: */
 
+%require "3.2"
+%language "c++"
 %defines
-%define apt.token.raw
-%define apt.token.constructor
+%define api.token.raw
+%define api.token.constructor
 %define api.value.type variant
 %define parse.assert
 
 %code requires {
 	#include <string>
-	class Clte::Driver;
+	#include <string_view>
+	#include <vector>
+	#include "Template.h"
+	namespace Clte
+	{
+		class Driver;
+	}
 }
 
 // The parsing context
@@ -53,11 +61,20 @@
 %define parse.lac full
 
 %code {
+	#include <sstream>
 	#include "Driver.h"
+	#include "Logger.h"
+
+	// Tokens come from the scanner owned by the Driver being used
+	static yy::parser::symbol_type yylex(Clte::Driver & drv_i)
+	{
+		return drv_i.lex();
+	}
 }
 
 %define api.token.prefix {TOK_}
 %token
+	END 0   "end of file"
 	EXPEND  "@."
 	BLKEND  "@;"
 	COMMENT "@#"
@@ -70,4 +87,90 @@
 	ATSIGN  "@@"
 ;
 
-%printer { yyo << $$; } <*>;
+// Literal text in the Template arena, the size of tags is the iteration
+// depth they refer to
+%token <std::string_view> TEXT "text"
+%token <size_t> KEY "@^"
+%token <size_t> VALUE "@+"
+
+%type <Clte::Template::List> items
+%type <Clte::Template::Node *> item literal
+%type <std::vector<std::string_view>> fragments
+%type <std::string_view> expression fragment
+
+%printer { yyo << $$; } <std::string_view> <size_t>;
+
+%% /** Grammar rules */
+
+template:
+	items { drv_i.tpl().root($1.head); }
+	;
+
+items:
+	%empty { $$ = Clte::Template::List{ nullptr, nullptr }; }
+	| items item { $$ = Clte::Template::append($1, $2); }
+	;
+
+item:
+	literal { $$ = $1; }
+	| OUTPUT expression EXPEND {
+		$$ = drv_i.tpl().node(Clte::Template::output_node, @1.begin.line, $2);
+	}
+	| EXEC expression BLKEND {
+		$$ = drv_i.tpl().node(Clte::Template::exec_node, @1.begin.line, $2);
+	}
+	| IF expression EXPEND items BLKEND {
+		$$ = drv_i.tpl().node(Clte::Template::if_node, @1.begin.line, $2);
+		$$->body = $4.head;
+	}
+	| IF expression EXPEND items ELSE items BLKEND {
+		$$ = drv_i.tpl().node(Clte::Template::if_node, @1.begin.line, $2);
+		$$->body = $4.head;
+		$$->alt = $6.head;
+	}
+	| ITERATE expression EXPEND items BLKEND {
+		$$ = drv_i.tpl().node(Clte::Template::iterate_node, @1.begin.line, $2);
+		$$->body = $4.head;
+	}
+	| KEY {
+		$$ = drv_i.tpl().node(Clte::Template::key_node, @1.begin.line);
+		$$->depth = $1;
+	}
+	| VALUE {
+		$$ = drv_i.tpl().node(Clte::Template::value_node, @1.begin.line);
+		$$->depth = $1;
+	}
+	;
+
+literal:
+	TEXT { $$ = drv_i.tpl().node(Clte::Template::literal_node, @1.begin.line, $1); }
+	| ATSIGN { $$ = drv_i.tpl().node(Clte::Template::literal_node, @1.begin.line, "@"); }
+	;
+
+// Iteration tags inside Lua code become calls into the renderer. The
+// fragments are joined once, when the whole expression is known.
+expression:
+	fragments { $$ = drv_i.tpl().join($1); }
+	;
+
+fragments:
+	%empty { }
+	| fragments fragment { $$ = std::move($1); $$.push_back($2); }
+	;
+
+fragment:
+	TEXT { $$ = $1; }
+	| ATSIGN { $$ = "@"; }
+	| KEY { $$ = drv_i.tpl().copy("clte.key(" + std::to_string($1) + ")"); }
+	| VALUE { $$ = drv_i.tpl().copy("clte.value(" + std::to_string($1) + ")"); }
+	;
+
+%% /** C++ code section */
+
+void yy::parser::error(const location_type & loc_i, const std::string & msg_i)
+{
+	std::ostringstream oss;
+
+	oss << loc_i;
+	LE("%s: %s", oss.str().c_str(), msg_i.c_str());
+}